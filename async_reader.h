@@ -0,0 +1,287 @@
+#ifndef ASYNC_READER_H
+#define ASYNC_READER_H
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <zlib.h>
+#include "log_reader.h"
+
+/*
+ * ******************************************************
+ *
+ * Line reader with its own I/O thread
+ *
+ * With the plain reader the program waits on the disk and parses on the same thread, so whenever a page isn't in memory yet
+ * the parser just sits there. Here a reader thread keeps reading the next blocks of the file (pread, 4MB by default) into a ring of buffers
+ * while the program parses the lines of the block it already has, so the disk and the parser work at the same time.
+ *
+ * Every block ends on a line boundary: the reader keeps the unfinished last line of a block and puts it at the start of the next one.
+ * So next_line() hands out views into a buffer, exactly like MappedLog::next_line. A view stays valid until the next call.
+ *
+ * Compressed logs ("*.gz") are decompressed by the same thread with zlib (gzread instead of pread), so the program gets plain lines
+ * while the decompression runs next to the parsing. Archived logs don't have to be unpacked to disk first.
+ *
+ * It also keeps track of where the time went:
+ *      - stall: time the program spent waiting because the next block wasn't read yet (the disk or the decompression is the bottleneck)
+ *      - read: time the reader thread spent inside pread / gzread
+ *
+ * A read that fails (a disk error, or a corrupt / truncated .gz) ends the input like the end of the file does, but it isn't one:
+ * read_failed() is true from then on and read_error() says what went wrong, so the program can tell a truncated log from a whole one.
+ *
+ * ******************************************************
+*/
+//true for the names of compressed logs
+inline bool is_gzip_filename(const std::string& filename){
+    return filename.size() > 3 && filename.compare(filename.size() - 3, 3, ".gz") == 0;
+}
+
+class AsyncReader{
+public:
+    AsyncReader(){};
+    ~AsyncReader(){
+        close();
+    };
+    AsyncReader(const AsyncReader&) = delete;
+    AsyncReader& operator=(const AsyncReader&) = delete;
+
+    //start reading filename in the background, returns false if it can't be opened
+    bool open(const std::string& filename, size_t block_size = 4 << 20, int buffer_count = 4){
+        close();
+        fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        if (is_gzip_filename(filename)){
+            //zlib reads the file through its own descriptor so fd stays ours to close
+            gz = gzdopen(dup(fd), "rb");
+            if (gz == NULL){
+                ::close(fd);
+                fd = -1;
+                return false;
+            }
+            gzbuffer(gz, 1 << 20);
+        }
+
+        buffers.assign(buffer_count < 2 ? 2 : buffer_count, Buffer());
+        for (size_t i = 0; i < buffers.size(); i++){
+            buffers[i].data.resize(block_size);
+        }
+        filled = 0;
+        write_idx = 0;
+        read_idx = 0;
+        holding = false;
+        stop = false;
+        cursor = 0;
+        stall_ns = 0;
+        read_ns = 0;
+        error.clear();
+
+        pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init(&not_full, NULL);
+        pthread_cond_init(&not_empty, NULL);
+        if (pthread_create(&reader, NULL, &start_reader, this) != 0){
+            perror("Failed to create the reader thread");
+            destroy();
+            return false;
+        }
+        return true;
+    };
+
+    bool is_open() const{
+        return fd >= 0;
+    };
+
+    //stop the reader thread and release everything
+    void close(){
+        if (fd < 0)
+            return;
+        pthread_mutex_lock(&mutex);
+        stop = true;
+        pthread_cond_broadcast(&not_full);
+        pthread_mutex_unlock(&mutex);
+        pthread_join(reader, NULL);
+        destroy();
+    };
+
+    //next line (without '\n' or a trailing '\r'), returns false at the end of the file (or when reading it failed, see read_failed())
+    bool next_line(std::string_view& line){
+        while (true){
+            if (holding){
+                Buffer& buf = buffers[read_idx];
+                if (MappedLog::scan_line(buf.data.data(), buf.length, cursor, line))
+                    return true;
+                if (buf.last)
+                    return false;
+                //done with this block, give it back to the reader
+                pthread_mutex_lock(&mutex);
+                holding = false;
+                read_idx = (read_idx + 1) % buffers.size();
+                filled--;
+                pthread_cond_signal(&not_full);
+                pthread_mutex_unlock(&mutex);
+            }
+
+            //take the next block, waiting for the reader if it isn't there yet
+            pthread_mutex_lock(&mutex);
+            if (filled == 0){
+                auto beg = std::chrono::steady_clock::now();
+                while (filled == 0)
+                    pthread_cond_wait(&not_empty, &mutex);
+                stall_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - beg).count();
+            }
+            holding = true;
+            cursor = 0;
+            pthread_mutex_unlock(&mutex);
+        }
+    };
+
+    //true if the input ended because a read failed, only meaningful once next_line() returned false
+    bool read_failed() const{
+        return !error.empty();
+    };
+    const std::string& read_error() const{
+        return error;
+    };
+
+    //milliseconds the program waited for the disk
+    double stall_ms() const{
+        return stall_ns / 1e6;
+    };
+    //milliseconds the reader thread spent in pread / gzread
+    double read_ms() const{
+        return read_ns / 1e6;
+    };
+
+private:
+    struct Buffer{
+        std::vector<char> data;
+        size_t length = 0;
+        bool last = false;      //true for the final block of the file
+    };
+
+    static void* start_reader(void* arg){
+        ((AsyncReader*)arg)->read_blocks();
+        return NULL;
+    };
+
+    //reader thread: fill free buffers one block at a time until the end of the file
+    void read_blocks(){
+        std::string carry;      //unfinished last line of the previous block
+        off_t offset = 0;
+        bool done = false;
+        while (!done){
+            pthread_mutex_lock(&mutex);
+            while (filled == buffers.size() && !stop)
+                pthread_cond_wait(&not_full, &mutex);
+            if (stop){
+                pthread_mutex_unlock(&mutex);
+                return;
+            }
+            pthread_mutex_unlock(&mutex);
+
+            //this buffer is free, nobody else touches it until it's published below
+            Buffer& buf = buffers[write_idx];
+            char* data = buf.data.data();
+            size_t capacity = buf.data.size();
+            memcpy(data, carry.data(), carry.size());
+            size_t length = carry.size();
+            carry.clear();
+
+            auto beg = std::chrono::steady_clock::now();
+            bool eof = false;
+            while (length < capacity){
+                ssize_t got;
+                if (gz != NULL)
+                    got = gzread(gz, data + length, (unsigned)(capacity - length));
+                else
+                    got = pread(fd, data + length, capacity - length, offset);
+                if (got < 0 && gz == NULL && errno == EINTR)
+                    continue;
+                if (got < 0 && gz == NULL)
+                    error = strerror(errno);
+                //a corrupt or truncated .gz can also just end early, zlib's error state tells that apart from the real end
+                if (got <= 0 && gz != NULL){
+                    int errnum = Z_OK;
+                    const char* message = gzerror(gz, &errnum);
+                    if (errnum != Z_OK && errnum != Z_STREAM_END)
+                        error = (message != NULL && message[0] != '\0') ? message : "gzread failed";
+                }
+                if (got <= 0){
+                    //end of the input (or a read error, see read_failed())
+                    eof = true;
+                    break;
+                }
+                length += got;
+                offset += got;
+            }
+            read_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - beg).count();
+
+            //keep the unfinished last line for the next block
+            //(a line longer than a whole block can't be kept together, it just gets cut and the parser rejects the pieces)
+            if (!eof){
+                const char* last_newline = (const char*)memrchr(data, '\n', length);
+                if (last_newline != NULL){
+                    size_t keep = last_newline - data + 1;
+                    carry.assign(data + keep, length - keep);
+                    length = keep;
+                }
+            }
+            buf.length = length;
+            buf.last = eof;
+            done = eof;
+
+            pthread_mutex_lock(&mutex);
+            write_idx = (write_idx + 1) % buffers.size();
+            filled++;
+            pthread_cond_signal(&not_empty);
+            pthread_mutex_unlock(&mutex);
+        }
+    };
+
+    void destroy(){
+        pthread_mutex_destroy(&mutex);
+        pthread_cond_destroy(&not_full);
+        pthread_cond_destroy(&not_empty);
+        if (gz != NULL){
+            gzclose(gz);
+            gz = NULL;
+        }
+        ::close(fd);
+        fd = -1;
+        std::vector<Buffer>().swap(buffers);
+    };
+
+    int fd = -1;
+    gzFile gz = NULL;           //only for compressed logs
+    pthread_t reader;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_full;    //signaled when the program gives a buffer back
+    pthread_cond_t not_empty;   //signaled when the reader fills a buffer
+
+    //ring of buffers: the reader fills buffers[write_idx], the program reads buffers[read_idx]
+    //filled counts the buffers the reader handed over that the program hasn't given back yet (including the one it's reading)
+    std::vector<Buffer> buffers;
+    size_t filled = 0;
+    size_t write_idx = 0, read_idx = 0;
+    bool stop = false;
+
+    //only touched by the program's thread
+    bool holding = false;       //true while the program is reading buffers[read_idx]
+    size_t cursor = 0;
+    uint64_t stall_ns = 0;
+
+    //only touched by the reader thread (read after close() or at the end of the file)
+    uint64_t read_ns = 0;
+    std::string error;          //why reading stopped early, empty if it got to the end
+};
+
+#endif
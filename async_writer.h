@@ -0,0 +1,267 @@
+#ifndef ASYNC_WRITER_H
+#define ASYNC_WRITER_H
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cerrno>
+#include <atomic>
+#include <string>
+#include <deque>
+#include "mpmc_ring.h"
+
+/*
+ * ******************************************************
+ *
+ * Output writer with its own thread
+ *
+ * The parallel programs used to write their output from the worker threads: take the file lock, open the output file in append mode,
+ * write (a task's lines, or in task_parallel_p1 a single line), close it again. An open + close per flagged hour, with every other
+ * thread that has something to write waiting on the lock in the meantime.
+ * Here one writer thread owns the output file for the whole run:
+ *      - workers hand over their text (a task's lines, ending in '\n') with write(): a push onto a lock-free ring (see mpmc_ring.h), no lock
+ *      - the writer thread takes the texts off the ring and appends them to a big buffer (1MB by default), and only writes the buffer
+ *        to the file descriptor when it's full, and once more at the end. The whole output is a handful of write calls
+ * The ring holds pointers, the text itself is moved and never copied on the way.
+ *
+ * write_in_order() is for output that has to come out in a set order no matter which thread finishes first (ex. the months of
+ * data_parallel_p1, so its output is the same as serial_p1's without sorting it). Every piece has a sequence number 0, 1, 2 ...
+ * and the writer thread keeps a reorder window: a piece that comes in before the ones ahead of it waits in the window, and as soon as
+ * the next piece in line is there, it and every waiting piece right after it go into the buffer. Only the writer thread ever looks
+ * at the window, so there's still no lock, and a thread that's done never waits for the slower ones.
+ * Every sequence number has to be written (an empty text just moves the window on), otherwise what's after it waits until close().
+ * The window is at most order_window pieces (an open() argument, ex. data_parallel_p1 passes the number of months it can queue):
+ * a piece more than that ahead of the next one in line, or one that was already written (a repeated or stale number), is a bug in the caller,
+ * it's dropped with a message and close() returns false.
+ *
+ * When the ring is empty the writer thread sleeps on a condition variable, and a worker only takes the lock to wake it up if it's asleep.
+ * Same event count as the sleeping workers of the pool (see work_stealing_pool.h): every write() bumps pushed after its push, and the writer
+ * only sleeps while pushed is still what it was before it found the ring empty.
+ *
+ * The text of one write() always ends up in the file in one piece, but the texts of different threads come in whatever order they're written.
+ * (unless they're written in order, see above)
+ *
+ * ******************************************************
+*/
+class AsyncWriter{
+public:
+    AsyncWriter() : queue(4096){};
+    ~AsyncWriter(){
+        close();
+    };
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+    //create (or empty) filename and start the writer thread, returns false if it can't be opened
+    //order_window: how far ahead of the next piece in line a piece of write_in_order() can be
+    bool open(const std::string& filename, size_t buffer_size = 1 << 20, size_t order_window = 4096){
+        close();
+        fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+        buffer.clear();
+        buffer.reserve(buffer_size);
+        capacity = buffer_size;
+        window_limit = order_window;
+        stop = false;
+        failed = false;
+        dropped = false;
+        write_calls = 0;
+        sleeping.store(false, std::memory_order_relaxed);
+        pushed.store(0, std::memory_order_relaxed);
+        next_seq = 0;
+
+        pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init(&not_empty, NULL);
+        if (pthread_create(&writer, NULL, &start_writer, this) != 0){
+            perror("Failed to create the writer thread");
+            destroy();
+            return false;
+        }
+        return true;
+    };
+
+    bool is_open() const{
+        return fd >= 0;
+    };
+
+    //hand text over to the writer thread (any thread, std::move the text in to skip the copy)
+    void write(std::string text){
+        if (text.empty())
+            return;
+        push(new Text{UNORDERED, std::move(text)});
+    };
+
+    //hand over piece number seq (any thread, once for every seq from 0 on), it's written after pieces 0 ... seq - 1
+    //seq has to be less than order_window (see open()) past the first piece that isn't written yet
+    void write_in_order(size_t seq, std::string text){
+        push(new Text{seq, std::move(text)});
+    };
+
+    //write out everything that was handed over, stop the writer thread and close the file. Returns false if any write failed
+    //(only once every thread is done calling write())
+    bool close(){
+        if (fd < 0)
+            return true;
+        pthread_mutex_lock(&mutex);
+        stop = true;
+        pthread_cond_signal(&not_empty);
+        pthread_mutex_unlock(&mutex);
+        pthread_join(writer, NULL);
+        bool ok = !failed && !dropped;
+        if (::close(fd) != 0)
+            ok = false;
+        fd = -1;
+        destroy();
+        return ok;
+    };
+
+    //write calls the output took (after close())
+    size_t writes() const{
+        return write_calls;
+    };
+
+private:
+    static const size_t UNORDERED = (size_t)-1;
+
+    struct Text{
+        size_t seq;
+        std::string text;
+    };
+
+    void push(Text* text){
+        queue.push(text);
+        pushed.fetch_add(1, std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_seq_cst)){
+            pthread_mutex_lock(&mutex);
+            pthread_cond_signal(&not_empty);
+            pthread_mutex_unlock(&mutex);
+        }
+    };
+
+    static void* start_writer(void* arg){
+        ((AsyncWriter*)arg)->write_texts();
+        return NULL;
+    };
+
+    //writer thread: gather the texts into the buffer, write it out whenever it's full, until close()
+    void write_texts(){
+        Text* text;
+        while (true){
+            unsigned long seen = pushed.load(std::memory_order_seq_cst);
+            if (queue.pop(text)){
+                append(text);
+                continue;
+            }
+
+            //nothing on the ring: sleep until write() or close() wakes us up
+            pthread_mutex_lock(&mutex);
+            sleeping.store(true, std::memory_order_seq_cst);
+            while (pushed.load(std::memory_order_seq_cst) == seen && !stop)
+                pthread_cond_wait(&not_empty, &mutex);
+            sleeping.store(false, std::memory_order_relaxed);
+            bool stopping = stop;
+            pthread_mutex_unlock(&mutex);
+            //close() is only called once nobody writes anymore, what's on the ring now is the last of it
+            if (stopping){
+                while (queue.pop(text))
+                    append(text);
+                break;
+            }
+        }
+        //pieces still waiting for one that never came, in order
+        for (size_t i = 0; i < window.size(); i++){
+            if (window[i] != NULL)
+                add_to_buffer(window[i]);
+        }
+        window.clear();
+        flush();
+    };
+
+    //a text off the ring: into the buffer, or into the reorder window if it has to wait for earlier pieces
+    void append(Text* text){
+        if (text->seq == UNORDERED){
+            add_to_buffer(text);
+            return;
+        }
+        if (text->seq < next_seq || text->seq - next_seq >= window_limit || (text->seq - next_seq < window.size() && window[text->seq - next_seq] != NULL)){
+            fprintf(stderr, "Output piece %zu is out of the order window (%zu ... %zu), dropped\n", text->seq, next_seq, next_seq + window_limit - 1);
+            dropped = true;
+            delete text;
+            return;
+        }
+        size_t slot = text->seq - next_seq;
+        if (window.size() <= slot)
+            window.resize(slot + 1, NULL);
+        window[slot] = text;
+        //the next piece in line and every one right after it that's already there
+        while (!window.empty() && window.front() != NULL){
+            add_to_buffer(window.front());
+            window.pop_front();
+            next_seq++;
+        }
+    };
+
+    void add_to_buffer(Text* text){
+        if (buffer.size() + text->text.size() > capacity)
+            flush();
+        buffer += text->text;
+        delete text;
+    };
+
+    //write the whole buffer to the file
+    void flush(){
+        size_t done = 0;
+        while (done < buffer.size() && !failed){
+            ssize_t written = ::write(fd, buffer.data() + done, buffer.size() - done);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0){
+                perror("Failed to write the output file");
+                failed = true;
+                break;
+            }
+            done += written;
+            write_calls++;
+        }
+        buffer.clear();
+    };
+
+    //after the thread is gone
+    void destroy(){
+        Text* text;
+        while (queue.pop(text))
+            delete text;
+        for (size_t i = 0; i < window.size(); i++){
+            delete window[i];
+        }
+        window.clear();
+        if (fd >= 0){
+            ::close(fd);
+            fd = -1;
+        }
+        pthread_mutex_destroy(&mutex);
+        pthread_cond_destroy(&not_empty);
+    };
+
+    int fd = -1;
+    MpmcRing<Text*> queue;
+    std::deque<Text*> window;       //window[i]: piece next_seq + i, NULL until it comes in
+    size_t next_seq = 0;
+    size_t window_limit = 0;
+    std::string buffer;
+    size_t capacity = 0;
+    bool failed = false;        //a write to the file failed
+    bool dropped = false;       //a piece of write_in_order() was out of the window
+    size_t write_calls = 0;
+
+    pthread_t writer;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    bool stop = false;
+    std::atomic<bool> sleeping{false};
+    std::atomic<unsigned long> pushed{0};
+};
+
+#endif
@@ -0,0 +1,89 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include "first_exceedance.h"
+
+using namespace std;
+
+/*
+ * ******************************************************
+ *
+ * Microbenchmark for the first exceedance search (first_exceedance.h)
+ *
+ * Compares the record by record float compare the 2nd pass used to do with the scalar int16 loop and the SSE2 / AVX2 paths,
+ * on hours of different lengths: one reading per second (3600), every 10 seconds (360) and every minute (60).
+ * The temperatures are a random walk and the thresholds are one stdev-ish below / above its middle, so some hours are flagged early,
+ * some late and some not at all (a full scan), like in a real log.
+ *
+ * Usage: ./bench_first_exceedance [total readings]     (default 20 million)
+ *
+ * Every variant sums up the positions it found so the compiler can't throw the work away, and the sums are printed
+ * next to the timings so it's easy to see that all variants agree.
+ *
+ * ******************************************************
+*/
+
+//the float thresholds, in degrees
+const float LOW = 63.5f;
+const float HIGH = 73.5f;
+
+//the way the 2nd pass used to look for the record
+size_t find_float(const int16_t* temps, size_t count, int16_t, int16_t){
+    for (size_t i = 0; i < count; i++){
+        float curr_temp = temps[i] / 10.0f;
+        if (curr_temp < LOW || curr_temp > HIGH)
+            return i;
+    }
+    return count;
+}
+
+//run one variant over every hour and print how long it took per hour
+void run(const char* name, size_t (*fn)(const int16_t*, size_t, int16_t, int16_t), const vector<int16_t>& temps, size_t hour_length){
+    int16_t low_bound, high_bound;
+    threshold_bounds(LOW, HIGH, low_bound, high_bound);
+    size_t hours = temps.size() / hour_length;
+
+    auto beg = std::chrono::high_resolution_clock::now();
+    long long checksum = 0;
+    size_t flagged = 0;
+    for (size_t h = 0; h < hours; h++){
+        size_t found = fn(temps.data() + h * hour_length, hour_length, low_bound, high_bound);
+        checksum += found;
+        flagged += (found < hour_length);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    double elapsed_ms = std::chrono::duration<double, std::milli>(end - beg).count();
+    printf("  %-16s %9.1f ms %9.1f ns/hour  flagged %zu/%zu  checksum %lld\n", name, elapsed_ms, elapsed_ms * 1e6 / hours, flagged, hours, checksum);
+}
+
+int main(int argc, char* argv[]){
+    size_t n = (argc > 1) ? strtoull(argv[1], NULL, 10) : 20000000;
+
+    //random walk temperature between 55 and 85 degrees that drifts slowly, so readings close in time are close in value
+    vector<int16_t> temps(n);
+    int temp = 685;
+    srand(7);
+    for (size_t i = 0; i < n; i++){
+        if (rand() % 8 == 0)
+            temp += rand() % 3 - 1;
+        temp = max(550, min(850, temp));
+        temps[i] = temp;
+    }
+
+    const size_t hour_lengths[] = {3600, 360, 60};
+    for (size_t length : hour_lengths){
+        printf("%zu readings per hour\n", length);
+        run("float compare", find_float, temps, length);
+        run("scalar int16", first_exceedance_scalar, temps, length);
+#if defined(__x86_64__) || defined(__i386__)
+        run("sse2", first_exceedance_sse2, temps, length);
+        if (__builtin_cpu_supports("avx2"))
+            run("avx2", first_exceedance_avx2, temps, length);
+#endif
+        run("dispatched", first_exceedance, temps, length);
+    }
+    return 0;
+}
@@ -0,0 +1,127 @@
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "log_reader.h"
+#include "record_parser.h"
+
+using namespace std;
+
+/*
+ * ******************************************************
+ *
+ * Microbenchmark for the record parser (record_parser.h)
+ *
+ * Compares the way the programs used to parse each line (stringstream split + substr + stod) with
+ * the scalar slow path and the SSE2 fast path (lines are always parsed one at a time).
+ *
+ * Usage: ./bench_record_parser [input log]
+ *      - with an input log, its lines are used (whatever the file contains, including malformed lines)
+ *      - without one, 5 million canonical lines are generated in memory
+ *
+ * Every variant sums up what it decoded so the compiler can't throw the work away, and the sums are printed
+ * next to the timings so it's easy to see that all variants agree.
+ *
+ * ******************************************************
+*/
+
+//the original per-line parsing code of the programs
+long long parse_stringstream(const vector<string_view>& lines){
+    long long checksum = 0;
+    for (size_t i = 0; i < lines.size(); i++){
+        string line(lines[i]);
+        stringstream ss(line);
+        string word;
+        int idx = 0;
+        string each_line[3];
+        while(getline(ss, word, ' ') && idx < 3){
+            each_line[idx] = word;
+            idx++;
+        }
+        string curr_year = each_line[0].substr(6, 2);
+        string curr_month = each_line[0].substr(0, 2);
+        string curr_hour = each_line[1].substr(0, 2);
+        float curr_temp = stod(each_line[2]);
+        checksum += stoi(curr_year) + stoi(curr_month) + stoi(curr_hour) + (long long)(curr_temp * 10 + 0.5f);
+    }
+    return checksum;
+}
+
+long long parse_scalar(const vector<string_view>& lines){
+    long long checksum = 0;
+    Record rec;
+    for (size_t i = 0; i < lines.size(); i++){
+        if (parse_record_scalar(lines[i], rec))
+            checksum += rec.year + rec.month + rec.hour + rec.temp;
+    }
+    return checksum;
+}
+
+long long parse_single(const vector<string_view>& lines){
+    long long checksum = 0;
+    Record rec;
+    for (size_t i = 0; i < lines.size(); i++){
+        if (parse_record(lines[i], rec))
+            checksum += rec.year + rec.month + rec.hour + rec.temp;
+    }
+    return checksum;
+}
+
+//run one variant and print how long it took per line
+void run(const char* name, long long (*fn)(const vector<string_view>&), const vector<string_view>& lines){
+    auto beg = std::chrono::high_resolution_clock::now();
+    long long checksum = fn(lines);
+    auto end = std::chrono::high_resolution_clock::now();
+    double elapsed_ms = std::chrono::duration<double, std::milli>(end - beg).count();
+    printf("%-22s %10.1f ms %8.2f ns/line  checksum %lld\n", name, elapsed_ms, elapsed_ms * 1e6 / lines.size(), checksum);
+}
+
+int main(int argc, char* argv[]){
+    MappedLog file;
+    string generated;
+    vector<string_view> lines;
+
+    if (argc > 1){
+        if (!file.open(argv[1])){
+            perror("Failed to open the input file");
+            return 1;
+        }
+        string_view line;
+        while (file.next_line(line)){
+            if (!line.empty())
+                lines.push_back(line);
+        }
+    }
+    else{
+        //one reading every second, random walk temperature between 55 and 85 degrees
+        const int n = 5000000;
+        generated.reserve((size_t)n * (RECORD_WIDTH + 1));
+        int temp = 680;
+        char buf[32];
+        srand(7);
+        for (int i = 0; i < n; i++){
+            temp += rand() % 5 - 2;
+            temp = max(550, min(850, temp));
+            int sec = i % 86400;
+            int day = (i / 86400) % 28 + 1;
+            int month = (i / (86400 * 28)) % 12 + 1;
+            snprintf(buf, sizeof(buf), "%02d/%02d/04 %02d:%02d:%02d %d.%d\n", month, day, sec / 3600, sec / 60 % 60, sec % 60, temp / 10, temp % 10);
+            generated += buf;
+        }
+        size_t pos = 0;
+        while (pos < generated.size()){
+            size_t newline = generated.find('\n', pos);
+            lines.push_back(string_view(generated).substr(pos, newline - pos));
+            pos = newline + 1;
+        }
+    }
+
+    printf("%zu lines\n", lines.size());
+    run("stringstream + stod", parse_stringstream, lines);
+    run("scalar", parse_scalar, lines);
+    run("simd (one line)", parse_single, lines);
+    return 0;
+}
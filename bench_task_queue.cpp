@@ -0,0 +1,177 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <pthread.h>
+#include <sched.h>
+#include "mpmc_ring.h"
+
+using namespace std;
+
+/*
+ * ******************************************************
+ *
+ * Contention benchmark for the task queues (mpmc_ring.h)
+ *
+ * Compares the queue the parallel programs used to have, a Task[256] array behind one mutex where taking a task shifts the rest
+ * down by one, with the lock-free ring. Producers push tasks while consumers pop them until every task went through, with no work
+ * in between, so the time is all queue overhead and waiting on each other. It's run for 1 to 8 consumers, with 1 producer (like
+ * the first pass handing out months one by one) and with as many producers as consumers.
+ *
+ * Usage: ./bench_task_queue [tasks]     (default 2 million)
+ *
+ * Every consumer sums up the tasks it got, and the total is checked against the sum of what was pushed, so a lost or
+ * doubled task shows up as a FAIL.
+ *
+ * ******************************************************
+*/
+
+//same size as a Task of data_parallel_p1 more or less
+struct BenchTask{
+    unsigned long start_idx, end_idx;
+    const void* hours;
+};
+
+//the old design: array + count, dequeue shifts everything left, all under one lock
+class ArrayQueue{
+public:
+    ArrayQueue(){
+        pthread_mutex_init(&mutex, NULL);
+    };
+    ~ArrayQueue(){
+        pthread_mutex_destroy(&mutex);
+    };
+    bool try_push(const BenchTask& task){
+        pthread_mutex_lock(&mutex);
+        bool ok = count < 256;
+        if (ok){
+            tasks[count] = task;
+            count++;
+        }
+        pthread_mutex_unlock(&mutex);
+        return ok;
+    };
+    void push(const BenchTask& task){
+        while (!try_push(task))
+            sched_yield();
+    };
+    bool pop(BenchTask& task){
+        pthread_mutex_lock(&mutex);
+        bool ok = count > 0;
+        if (ok){
+            task = tasks[0];
+            for (int i = 0; i < count - 1; i++){
+                tasks[i] = tasks[i + 1];
+            }
+            count--;
+        }
+        pthread_mutex_unlock(&mutex);
+        return ok;
+    };
+
+private:
+    pthread_mutex_t mutex;
+    BenchTask tasks[256];
+    int count = 0;
+};
+
+template <typename Queue>
+struct Run{
+    Queue* queue;
+    size_t tasks_per_producer;
+    int producer_count;
+    volatile int producers_done;
+    pthread_mutex_t done_mutex;
+    unsigned long long consumed_sum;
+};
+
+template <typename Queue>
+void* produce(void* arg){
+    Run<Queue>* run = (Run<Queue>*)arg;
+    for (size_t i = 0; i < run->tasks_per_producer; i++){
+        BenchTask task = {i, i + 1, NULL};
+        run->queue->push(task);
+    }
+    pthread_mutex_lock(&run->done_mutex);
+    run->producers_done++;
+    pthread_mutex_unlock(&run->done_mutex);
+    return NULL;
+}
+
+template <typename Queue>
+void* consume(void* arg){
+    Run<Queue>* run = (Run<Queue>*)arg;
+    unsigned long long sum = 0;
+    BenchTask task;
+    while (true){
+        if (run->queue->pop(task)){
+            sum += task.start_idx;
+            continue;
+        }
+        //empty: done if every producer is done (and the queue is still empty after that)
+        pthread_mutex_lock(&run->done_mutex);
+        bool done = run->producers_done == run->producer_count;
+        pthread_mutex_unlock(&run->done_mutex);
+        if (done && !run->queue->pop(task))
+            break;
+        if (done)
+            sum += task.start_idx;
+        else
+            sched_yield();
+    }
+    pthread_mutex_lock(&run->done_mutex);
+    run->consumed_sum += sum;
+    pthread_mutex_unlock(&run->done_mutex);
+    return NULL;
+}
+
+//push & pop total tasks with the given threads, print the time per task
+template <typename Queue>
+void run(const char* name, Queue& queue, size_t total, int producers, int consumers){
+    Run<Queue> bench;
+    bench.queue = &queue;
+    bench.tasks_per_producer = total / producers;
+    bench.producer_count = producers;
+    bench.producers_done = 0;
+    bench.consumed_sum = 0;
+    pthread_mutex_init(&bench.done_mutex, NULL);
+
+    auto beg = std::chrono::high_resolution_clock::now();
+    vector<pthread_t> ids(producers + consumers);
+    for (int i = 0; i < consumers; i++){
+        pthread_create(&ids[i], NULL, consume<Queue>, &bench);
+    }
+    for (int i = 0; i < producers; i++){
+        pthread_create(&ids[consumers + i], NULL, produce<Queue>, &bench);
+    }
+    for (size_t i = 0; i < ids.size(); i++){
+        pthread_join(ids[i], NULL);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    pthread_mutex_destroy(&bench.done_mutex);
+
+    size_t pushed = bench.tasks_per_producer * producers;
+    unsigned long long expected = (unsigned long long)producers * bench.tasks_per_producer * (bench.tasks_per_producer - 1) / 2;
+    double elapsed_ms = std::chrono::duration<double, std::milli>(end - beg).count();
+    printf("  %-12s %2d producer(s) %2d consumer(s) %9.1f ms %8.1f ns/task  %s\n", name, producers, consumers, elapsed_ms,
+           elapsed_ms * 1e6 / pushed, bench.consumed_sum == expected ? "ok" : "FAIL");
+}
+
+int main(int argc, char* argv[]){
+    size_t total = (argc > 1) ? strtoull(argv[1], NULL, 10) : 2000000;
+
+    const int consumer_counts[] = {1, 2, 4, 8};
+    for (int producers_match = 0; producers_match < 2; producers_match++){
+        printf(producers_match ? "as many producers as consumers\n" : "1 producer\n");
+        for (int consumers : consumer_counts){
+            int producers = producers_match ? consumers : 1;
+            ArrayQueue array_queue;
+            run("array+mutex", array_queue, total, producers, consumers);
+            //same capacity as the array, so both fill up the same way
+            MpmcRing<BenchTask> ring(256);
+            run("mpmc ring", ring, total, producers, consumers);
+        }
+    }
+    return 0;
+}
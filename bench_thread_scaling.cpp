@@ -0,0 +1,197 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "work_stealing_pool.h"
+
+using namespace std;
+
+/*
+ * ******************************************************
+ *
+ * Thread count sweep for the work-stealing pool (work_stealing_pool.h)
+ *
+ * Runs the two task shapes of the parallel programs on synthetic months, for 1, 2, 4, ... threads up to twice the hardware threads:
+ *      - months: one task per month that goes through every hour of it (data_parallel_p1)
+ *      - months > hours > output: a month task spawns a task per hour, and an hour past the threshold spawns an output task (task_parallel_p1)
+ * Every hour is read in full (like the degree-hour sum of energy_waste.h), so the work is memory bound the way the 2nd pass is.
+ * The months don't all have the same length (half to one and a half of the average), so threads that run out of months early
+ * have to steal to keep busy.
+ *
+ * Last, light load: one month is submitted every 20 ms for a second, so the threads are idle most of the time. It prints how much CPU
+ * the whole process used in that second; idle threads sleep (see work_stealing_pool.h), so it should be about the work itself.
+ *
+ * Usage: ./bench_thread_scaling [months] [readings per hour]     (default 240 months, 600 readings)
+ *
+ * The speedup is against 1 thread. Every run adds up what its tasks found, and the total is checked against a plain loop,
+ * so a lost or doubled task shows up as a FAIL.
+ *
+ * ******************************************************
+*/
+
+struct BenchMonth{
+    size_t start_idx;       //first reading of the month
+    uint32_t hours;
+};
+
+struct BenchTask{
+    //0: month, 1: hour, 2: output
+    int stage;
+    size_t start_idx;
+    uint32_t hours;
+};
+
+vector<int16_t> temps;
+vector<BenchMonth> months;
+uint32_t readings_per_hour;
+const int16_t HIGH_BOUND = 735;
+
+//readings past the threshold in one hour
+uint64_t hour_sum(size_t start_idx){
+    const int16_t* hour = temps.data() + start_idx;
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < readings_per_hour; i++){
+        sum += hour[i] > HIGH_BOUND ? hour[i] - HIGH_BOUND : 0;
+    }
+    return sum;
+}
+
+//one counter per worker, on its own cache line
+struct alignas(64) WorkerSum{
+    uint64_t value = 0;
+};
+
+//run every month through a pool with thread_count threads, returns the time in ms
+double run(int thread_count, bool split_hours, uint64_t& total){
+    vector<WorkerSum> sums(thread_count);
+    WorkStealingPool<BenchTask>* pool_ptr = NULL;
+    auto run_task = [&](BenchTask& task, int worker){
+        if (task.stage == 0 && !split_hours){
+            for (uint32_t h = 0; h < task.hours; h++){
+                sums[worker].value += hour_sum(task.start_idx + (size_t)h * readings_per_hour);
+            }
+        }
+        else if (task.stage == 0){
+            for (uint32_t h = 0; h < task.hours; h++){
+                BenchTask hour = {1, task.start_idx + (size_t)h * readings_per_hour, 1};
+                pool_ptr->spawn(worker, hour);
+            }
+        }
+        else if (task.stage == 1){
+            uint64_t sum = hour_sum(task.start_idx);
+            if (sum != 0){
+                BenchTask output = {2, (size_t)sum, 0};
+                pool_ptr->spawn(worker, output);
+            }
+        }
+        else{
+            sums[worker].value += task.start_idx;
+        }
+    };
+
+    auto beg = std::chrono::high_resolution_clock::now();
+    {
+        WorkStealingPool<BenchTask> pool(thread_count, run_task, months.size());
+        pool_ptr = &pool;
+        for (size_t m = 0; m < months.size(); m++){
+            BenchTask task = {0, months[m].start_idx, months[m].hours};
+            pool.submit(task);
+        }
+        pool.close();
+        pool.wait();
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    total = 0;
+    for (int i = 0; i < thread_count; i++){
+        total += sums[i].value;
+    }
+    return std::chrono::duration<double, std::milli>(end - beg).count();
+}
+
+//CPU time of the process so far (every thread), in ms
+double cpu_ms(){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e3 + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e3;
+}
+
+//a month every 20 ms for 1 second with thread_count threads, returns the CPU time used in ms
+double run_light(int thread_count){
+    vector<WorkerSum> sums(thread_count);
+    auto run_task = [&](BenchTask& task, int worker){
+        for (uint32_t h = 0; h < task.hours; h++){
+            sums[worker].value += hour_sum(task.start_idx + (size_t)h * readings_per_hour);
+        }
+    };
+    WorkStealingPool<BenchTask> pool(thread_count, run_task, months.size());
+    double beg = cpu_ms();
+    for (int i = 0; i < 50; i++){
+        const BenchMonth& month = months[i % months.size()];
+        BenchTask task = {0, month.start_idx, month.hours};
+        pool.submit(task);
+        usleep(20000);
+    }
+    pool.close();
+    pool.wait();
+    return cpu_ms() - beg;
+}
+
+int main(int argc, char* argv[]){
+    size_t month_count = (argc > 1) ? strtoull(argv[1], NULL, 10) : 240;
+    readings_per_hour = (argc > 2) ? strtoul(argv[2], NULL, 10) : 600;
+    if (month_count == 0 || readings_per_hour == 0){
+        cerr << "Usage: ./bench_thread_scaling [months] [readings per hour]\n";
+        return 1;
+    }
+
+    //months of 360 to 1080 hours (720 on average), a random walk of temperatures around 70 degrees
+    srand(12);
+    size_t total_readings = 0;
+    for (size_t m = 0; m < month_count; m++){
+        BenchMonth month = {total_readings, (uint32_t)(360 + rand() % 721)};
+        months.push_back(month);
+        total_readings += (size_t)month.hours * readings_per_hour;
+    }
+    temps.resize(total_readings);
+    int temp = 700;
+    for (size_t i = 0; i < total_readings; i++){
+        temp += rand() % 5 - 2;
+        if (temp < 600 || temp > 800)
+            temp = 700;
+        temps[i] = temp;
+    }
+
+    uint64_t expected = 0;
+    for (size_t m = 0; m < months.size(); m++){
+        for (uint32_t h = 0; h < months[m].hours; h++){
+            expected += hour_sum(months[m].start_idx + (size_t)h * readings_per_hour);
+        }
+    }
+
+    int hardware = WorkStealingPool<BenchTask>::default_threads(0);
+    int max_threads = hardware > 4 ? hardware * 2 : 8;
+    printf("%zu months, %zu readings (%.1f MB), %d hardware threads\n", months.size(), total_readings,
+           total_readings * sizeof(int16_t) / 1e6, hardware);
+    for (int split = 0; split < 2; split++){
+        printf(split ? "months > hours > output\n" : "months\n");
+        double single = 0;
+        for (int threads = 1; threads <= max_threads; threads *= 2){
+            uint64_t total;
+            double elapsed_ms = run(threads, split, total);
+            if (threads == 1)
+                single = elapsed_ms;
+            printf("  %3d thread(s) %9.1f ms  speedup %5.2fx  %s\n", threads, elapsed_ms, single / elapsed_ms,
+                   total == expected ? "ok" : "FAIL");
+        }
+    }
+    printf("light load (a month every 20 ms for 1 s)\n");
+    for (int threads = 1; threads <= max_threads; threads *= 2){
+        printf("  %3d thread(s) %9.1f ms of CPU\n", threads, run_light(threads));
+    }
+    return 0;
+}
@@ -0,0 +1,160 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <zlib.h>
+#include "log_reader.h"
+#include "record_parser.h"
+#include "season_policy.h"
+
+/*
+ * ******************************************************
+ *
+ * Checkpoint of a P1 run, for logs that only ever get appended to
+ *
+ * A rerun over the full history redoes months that can't change anymore. With a checkpoint, a run (--incremental) saves where it stopped:
+ *      - offset: how far into the log it got (always the start of a line)
+ *      - the thresholds (mean + stdev, mean - stdev) of every finished month
+ *      - the open month: the last month of the log, which can still get more records. Its kept records are saved
+ *        (6 bytes each, like the record store) together with the anomaly filter's prev_temp at the offset, and the hour check state
+ *        at the start of that month
+ * The next run loads it, reads only the part of the log after offset, and re-does the open month plus whatever new months came in.
+ * So the output of an incremental run only has the months that changed.
+ *
+ * The checkpoint is only used if the log still starts with the same bytes and is at least offset long, otherwise the log was replaced
+ * (not appended to) and the run starts over from the beginning. Thresholds and filter state depend on the season policy (see season_policy.h),
+ * so a checkpoint saved with another policy isn't used either.
+ *
+ * File layout (native byte order): CheckpointHeader, the finished months (MonthThreshold each), the open month's timestamps (uint32 each)
+ * and temperatures (int16 each)
+ *
+ * ******************************************************
+*/
+
+const char CHECKPOINT_MAGIC[8] = {'T', 'E', 'M', 'P', 'C', 'K', 'P', 'T'};
+const uint32_t CHECKPOINT_VERSION = 1;
+//how much of the start of the log goes into the checksum that tells whether it's still the same log
+const uint64_t CHECKPOINT_PREFIX_BYTES = 1 << 20;
+
+//thresholds of one finished month
+struct MonthThreshold{
+    int32_t year, month;
+    float high, low;    //mean + stdev, mean - stdev
+};
+
+struct CheckpointHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t prefix_crc;        //crc32 of the first min(offset, CHECKPOINT_PREFIX_BYTES) bytes of the log
+    uint64_t offset;
+    float prev_temp;
+    int32_t prev_hour;
+    int32_t skip_flag;
+    uint32_t policy;            //fingerprint of the season policy (0 = default)
+    uint64_t finished_count;
+    uint64_t open_count;
+};
+
+//crc32 of the start of the log, the part an append never touches
+inline uint32_t log_prefix_crc(const char* data, uint64_t offset){
+    uint64_t len = (offset < CHECKPOINT_PREFIX_BYTES) ? offset : CHECKPOINT_PREFIX_BYTES;
+    return crc32(crc32(0L, Z_NULL, 0), (const Bytef*)data, (uInt)len);
+}
+
+struct Checkpoint{
+    uint64_t offset = 0;
+    uint32_t prefix_crc = 0;
+    float prev_temp = 0;
+    //hour check state at the start of the open month (only serial_p1 carries it over from one month to the next)
+    int prev_hour = -1;
+    bool skip_flag = false;
+    std::vector<MonthThreshold> finished;
+    std::vector<Record> open_month;
+
+    //read filename, returns false if there's no checkpoint, it doesn't belong to this log or it was made with another policy
+    bool load(const std::string& filename, const MappedLog& log, const SeasonPolicy& policy){
+        FILE* in = fopen(filename.c_str(), "rb");
+        if (in == NULL)
+            return false;
+        CheckpointHeader header;
+        bool ok = fread(&header, sizeof(header), 1, in) == 1 &&
+                  memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) == 0 && header.version == CHECKPOINT_VERSION &&
+                  header.policy == policy.fingerprint() &&
+                  header.offset <= log.complete_size() && header.prefix_crc == log_prefix_crc(log.data(), header.offset);
+        if (ok){
+            finished.resize(header.finished_count);
+            std::vector<uint32_t> timestamps(header.open_count);
+            std::vector<int16_t> temps(header.open_count);
+            ok = (finished.empty() || fread(finished.data(), sizeof(MonthThreshold), finished.size(), in) == finished.size()) &&
+                 (timestamps.empty() || fread(timestamps.data(), sizeof(uint32_t), timestamps.size(), in) == timestamps.size()) &&
+                 (temps.empty() || fread(temps.data(), sizeof(int16_t), temps.size(), in) == temps.size());
+            open_month.resize(header.open_count);
+            for (size_t i = 0; ok && i < open_month.size(); i++){
+                unpack_timestamp(timestamps[i], open_month[i]);
+                open_month[i].temp = temps[i];
+            }
+        }
+        fclose(in);
+        if (!ok){
+            *this = Checkpoint();
+            return false;
+        }
+        offset = header.offset;
+        prefix_crc = header.prefix_crc;
+        prev_temp = header.prev_temp;
+        prev_hour = header.prev_hour;
+        skip_flag = header.skip_flag != 0;
+        return true;
+    };
+
+    //the log was read up to new_offset (call this while the log is still open)
+    void set_offset(const MappedLog& log, uint64_t new_offset){
+        offset = new_offset;
+        prefix_crc = log_prefix_crc(log.data(), new_offset);
+    };
+
+    //write filename, stamped with the policy the thresholds & filter state are for, returns false if it couldn't be written
+    //written to a temporary file first and renamed, so a crash never leaves half a checkpoint
+    bool save(const std::string& filename, const SeasonPolicy& policy) const{
+        CheckpointHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+        header.version = CHECKPOINT_VERSION;
+        header.prefix_crc = prefix_crc;
+        header.offset = offset;
+        header.prev_temp = prev_temp;
+        header.prev_hour = prev_hour;
+        header.skip_flag = skip_flag;
+        header.policy = policy.fingerprint();
+        header.finished_count = finished.size();
+        header.open_count = open_month.size();
+
+        std::vector<uint32_t> timestamps(open_month.size());
+        std::vector<int16_t> temps(open_month.size());
+        for (size_t i = 0; i < open_month.size(); i++){
+            timestamps[i] = pack_timestamp(open_month[i]);
+            temps[i] = open_month[i].temp;
+        }
+
+        std::string tmp_filename = filename + ".tmp";
+        FILE* out = fopen(tmp_filename.c_str(), "wb");
+        if (out == NULL)
+            return false;
+        bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+                  (finished.empty() || fwrite(finished.data(), sizeof(MonthThreshold), finished.size(), out) == finished.size()) &&
+                  (timestamps.empty() || fwrite(timestamps.data(), sizeof(uint32_t), timestamps.size(), out) == timestamps.size()) &&
+                  (temps.empty() || fwrite(temps.data(), sizeof(int16_t), temps.size(), out) == temps.size());
+        ok = (fclose(out) == 0) && ok;
+        if (!ok || rename(tmp_filename.c_str(), filename.c_str()) != 0){
+            remove(tmp_filename.c_str());
+            return false;
+        }
+        return true;
+    };
+};
+
+#endif
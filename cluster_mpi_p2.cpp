@@ -1,12 +1,13 @@
 #include <iostream>
 #include <fstream>
 #include <string>
-#include <sstream>
 #include <vector>
 #include <unordered_map>
 #include <chrono>
 #include <cmath>
 #include "mpi.h"
+#include "record_parser.h"
+#include "log_input.h"
 
 using namespace std;
 
@@ -116,7 +117,8 @@ int main(void)
   int my_rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
 
-  ifstream file(input_filename);
+  // read the binary cache of the input file if there's an up to date one, otherwise the memory-mapped text (see log_input.h)
+  LogInput file(input_filename);
   auto start = std::chrono::high_resolution_clock::now();
 
   /**
@@ -128,64 +130,33 @@ int main(void)
   {
     /**
      * 
-     * Read each line of the text file
+     * Read each record of the file
      * 
     */
-    string line;
-    while (getline(file, line))
-    {
-      // skip blank line
-      if (line == "")
-        continue;
-
-      /*
-       *
-       * Using stringstream, I separate the string by their white spaces -> split them into 3 segments
-       * then I store each segment into each_line array
-       * Ex. 06/05/04 01:59:37 68.1 -> each_line[0] = 06/05/04, each_line[1] = 01:59:37, each_line[2] = 68.1
-       *
-       */
-      stringstream ss(line);
-      string word;
-      int idx = 0;
-      string each_line[3];
-      while (getline(ss, word, ' '))
-      {
-        each_line[idx] = word;
-        idx++;
-      }
+    // feature vector of the day we're currently reading, and the date of the last record that was read
+    // the day only changes once every few thousand lines, so the map lookup with the string keys is only done when it does
+    unordered_map<int, int> *curr_day_temp = NULL;
+    Record prev_rec = Record();
 
-      /**
-       *
-       * By reading the substring of each index of the array, I can get current year, current month, current day, and current temperature
-       * Since each_line[0] is like 06/05/04 -> can get year, month, day
-       * Since each_line[2] only contains temperature as string -> convert to decimal & round it to an int (to make everyone's life easier)
-       *
-       */
-      string curr_year = each_line[0].substr(6, 2);
-      string curr_month = each_line[0].substr(0, 2);
-      string curr_day = each_line[0].substr(3, 2);
-      int curr_temp = round(stod(each_line[2]));
-
-      /**
-       *
-       * use global variable log_info_map to insert data
-       * One thing that I like about map is that if it doesn't contain the key that you're looking for, it creates one for you (only when you
-       * try to access them using brackets [])
-       * Therefore, if current year, current month, current day, and current temperature doesn't exist in map -> it creates one for you, set it to value 0
-       * But since we're currently at current temperature -> add 1 to it (because we want feature vector that stores the occurrence of temperature
-       * within that day)
-       * In this way, I can keep adding 1s to the corresponding temperature whenever I read the input text file
-       *
-       */
-      log_info_map[curr_year][curr_month][curr_day][curr_temp] += 1;
+    /**
+     *
+     * Each record is already decoded into integers (see record_parser.h), blank and malformed lines are skipped by the reader
+     * Ex. 06/05/04 01:59:37 68.1 -> month 6, day 5, year 4, temperature 681 (tenths of a degree)
+     * Round the temperature to an int (to make everyone's life easier)
+     *
+     */
+    Record rec;
+    while (file.next_record(rec))
+    {
+      int curr_temp = round(rec.temp / 10.0);
 
       /**
        *
        * Now, one problem that we're having here is that we do not know which year,month,or day we have visited so far!
        * So, we need a list that stores all the date that we have found
        *
-       * First, make DateInfo with current year, current month, and current day because that's what date_list is made up of.
+       * Whenever the date is different from the previous record (or it's the first record), make DateInfo with current year, current month, and current day
+       * because that's what date_list is made up of.
        * Then, using if statement, first check if date_list is empty -> if it is, we insert the current DateInfo instance
        *      - Have to do this because if date_list is empty but we try to access it using [] -> error occurs
        * If date_list is not empty -> then check if the latest DateInfo element of the list is the same as our current DateInfo instance
@@ -194,18 +165,47 @@ int main(void)
        *      - Notice that I didn't increment date_list_idx from date_list.empty() if statement. It is because date_list_idx starts from 0
        *          - so when an element is added for the first time to list -> it will be stored at list[0] -> so no need to increment date_list_idx
        *
+       * Also look up the feature vector of the day in log_info_map here
+       * One thing that I like about map is that if it doesn't contain the key that you're looking for, it creates one for you (only when you
+       * try to access them using brackets [])
+       * The pointer stays valid even when log_info_map grows, because unordered_map never moves its elements
+       *
        */
-      DateInfo di = DateInfo(curr_year, curr_month, curr_day);
-
-      if (date_list.empty())
-      {
-        date_list.push_back(di);
-      }
-      else if (!(date_list[date_list_idx] == di))
+      if (curr_day_temp == NULL || rec.day != prev_rec.day || rec.month != prev_rec.month || rec.year != prev_rec.year)
       {
-        date_list.push_back(di);
-        date_list_idx += 1;
+        DateInfo di = DateInfo(two_digits(rec.year), two_digits(rec.month), two_digits(rec.day));
+
+        if (date_list.empty())
+        {
+          date_list.push_back(di);
+        }
+        else if (!(date_list[date_list_idx] == di))
+        {
+          date_list.push_back(di);
+          date_list_idx += 1;
+        }
+
+        curr_day_temp = &log_info_map[di.year][di.month][di.day];
+        prev_rec = rec;
       }
+
+      /**
+       *
+       * Insert the data to the feature vector of the current day
+       * If current temperature doesn't exist in the feature vector -> it creates one for you, set it to value 0
+       * But since we're currently at current temperature -> add 1 to it (because we want feature vector that stores the occurrence of temperature
+       * within that day)
+       * In this way, I can keep adding 1s to the corresponding temperature whenever I read the input text file
+       *
+       */
+      (*curr_day_temp)[curr_temp] += 1;
+    }
+
+    //every process reads the log itself, one that couldn't read all of it (ex. a corrupt .gz) stops the whole run
+    if (file.read_failed())
+    {
+      cerr << "Failed to read " << input_filename << ": " << file.read_error() << "\n";
+      MPI_Abort(MPI_COMM_WORLD, 1);
     }
 
     file.close();
@@ -0,0 +1,55 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include "log_cache.h"
+
+using namespace std;
+
+/*
+ * ******************************************************
+ *
+ * Converter from a text temperature log to its binary columnar cache (see log_cache.h)
+ *
+ * Usage: ./convert_log_cache <input log> [cache file]
+ *      - the cache file defaults to "<input log>.cache", which is where all the programs look for it
+ *      - the input log can be compressed ("*.gz"), it's decompressed on the fly
+ *
+ * For a plain text log it also writes "<input log>.index" (see log_index.h), so programs can seek to a date range.
+ *
+ * Run it again whenever the log changes. Until then, the programs notice that the cache is older than the log
+ * (or was built from a log of a different size) and fall back to reading the text.
+ *
+ * ******************************************************
+*/
+int main(int argc, char* argv[]){
+    if (argc < 2){
+        cerr << "usage: " << argv[0] << " <input log> [cache file]\n";
+        return 1;
+    }
+    string log_filename = argv[1];
+    string cache_filename = (argc > 2) ? argv[2] : log_cache_filename(log_filename);
+
+    auto beg = std::chrono::high_resolution_clock::now();
+    LogIndexBuilder index(season_policy);
+    long long records = build_log_cache(log_filename, cache_filename, &index);
+    auto end = std::chrono::high_resolution_clock::now();
+    auto elapsed_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - beg).count();
+
+    if (records < 0){
+        cerr << "Failed to convert " << log_filename << " into " << cache_filename << "\n";
+        return 1;
+    }
+    cout << "wrote " << records << " records to " << cache_filename << " in " << elapsed_time << " ms\n";
+
+    //the index belongs to the text log, so it's written next to the log (a .gz log has none)
+    if (!is_gzip_filename(log_filename)){
+        struct stat st;
+        string index_filename = log_index_filename(log_filename);
+        if (stat(log_filename.c_str(), &st) != 0 || !index.write(index_filename, st.st_size)){
+            cerr << "Failed to write " << index_filename << "\n";
+            return 1;
+        }
+        cout << "wrote " << index.entries().size() << " hours to " << index_filename << "\n";
+    }
+    return 0;
+}
@@ -2,15 +2,20 @@
 #include <pthread.h>
 #include <fstream>
 #include <string>
-#include <sstream>
+#include <string_view>
 #include <vector>
-#include <unordered_map>
 #include <chrono>
-#include <cmath>
-
-//declare the number threads that we're going to use from here
-//used define so that whenever we make changes to it, simply change this number
-#define THREAD_NUM 5
+#include "record_parser.h"
+#include "log_input.h"
+#include "record_store.h"
+#include "parallel_first_pass.h"
+#include "checkpoint.h"
+#include "log_index.h"
+#include "season_policy.h"
+#include "hour_summary.h"
+#include "energy_waste.h"
+#include "work_stealing_pool.h"
+#include "async_writer.h"
 
 using namespace std;
 
@@ -20,9 +25,9 @@ using namespace std;
  * Data Parallelism
  * 
  * How I approached segmenting data into pieces:
- * I created a struct called task that can have indices of when each month starts & ends.  These indices will be used on "text_input", a vector of string
- * that saves all the string lines of the input file except for anomalies & new line
- * Each thread will use this task to access certain index of this vector of string to retrieve all the temperatures (for each sec) for each month
+ * I created a struct called task that can have indices of when each month starts & ends.  These indices will be used on "text_input", a compact record store
+ * that saves all the records of the input file except for anomalies & new line
+ * Each thread will use this task to access certain index of this record store to retrieve all the temperatures (for each sec) for each month
  * Each thread will be given task that has information of each month --> so none of the threads will access the same month or same data chunks
  * This ensures that all the threads will be working on their own data segments independently
  * 
@@ -31,11 +36,12 @@ using namespace std;
  * I have decided cooling months as: May, June, July, August
  * I have decided heating months as: October, November, December, January, February
  * March, April, and September are not considered and therefore, ignored
+ * (that's the default season policy, --seasons changes it, see season_policy.h)
  * 
  * Note on how I decided to find over-heating and over-cooling:
  * I first read the whole month, find typical temperature (average) of that month and its standard deviation, and save them in map.
- * Also, save all the valid lines (ignore newlines and anomalies) of input file in a vector of string.
- * Then in the 2nd run with vector of string, I use this average with stdev to determine over-cooling & over-heating status of each hour by comparing each temperature
+ * Also, save all the valid records (ignore newlines and anomalies) of input file in a record store.
+ * Then in the 2nd run with the record store, I use this average with stdev to determine over-cooling & over-heating status of each hour by comparing each temperature
  * with what's in the map depending on what month we're currently in (only for either cooling or heating month)
  * 
  * *******************************************************
@@ -45,7 +51,7 @@ using namespace std;
  **********************************************************
  * 
  * This is the task that each thread gets
- * It has start index and end index of when each month ends in "text_input" vector of string that saves ALL the valid temperatures from input file
+ * It has start index and end index of when each month ends in "text_input" record store that saves ALL the valid temperatures from input file
  * Each thread uses this to access certain data points saved in the vector, similar to how the data is chunked and is read by threads
  * These indices will never overlap with other threads, so each chunk of data is read independently by each thread
  * 
@@ -60,6 +66,17 @@ using namespace std;
 typedef struct Task{
     //start_idx for start date, end_idx for end date of specific month
     unsigned long start_idx, end_idx;
+    //summary of every hour of the month, built by the first pass (see hour_summary.h). Index mode builds them when the month is read
+    const vector<HourSummary>* hours = NULL;
+    //index mode (--index) only: the month isn't read yet, the task reads it from bytes [byte_begin, byte_end) of the log
+    //with the anomaly filter starting from prev_temp
+    int year, month;
+    size_t byte_begin, byte_end;
+    float prev_temp;
+    //where the month is among the months of the run (0, 1, 2 ... in log order), its lines go into the output file in that order
+    size_t seq = 0;
+    //season policy the month's thresholds were (or in index mode are) set with, the month is filtered & checked with the same one
+    const SeasonPolicy* policy = NULL;
     //struct constructor
     Task(){};
     Task(unsigned long start, unsigned long end){
@@ -69,164 +86,225 @@ typedef struct Task{
 }Task;
 
 //IMPORTANT: I've set all of these variables as global because the threads need to use them as well from a separate method call
+//(the tasks themselves are handed to a work-stealing pool made in main, see work_stealing_pool.h)
 
-//task queue is the queue that has all the tasks. Each task = start and end index of each month for text_input vector of string
-//So 256 can cover a little more than all months of 21 years, which is more than enough (21 x 12 = 252)
-Task task_queue[256];
-//task_count to keep the total number of tasks inside the queue
-int task_count = 0;
-
-//Since anything in the task queue and output file are a critical section (bc overwriting or loss of data can happen), need mutex lock
-pthread_mutex_t mutex_queue;    //mutex lock for task queue bc we have to allow only 1 thread to rearrange queue
-pthread_mutex_t mutex_file;     //mutex lock for output file bc we have to allow only 1 thread to write to output file
+//the output file used to be a critical section that every thread opened & appended to under a lock
+//now one writer thread owns it (see async_writer.h), the threads just hand it the lines of each task
+AsyncWriter output_writer;
 
-//store each lines of the text
+//store each valid record of the text
 /*
- * since the maximum size of the vector of string is at least 2^42 – 1 (2^(64 – size(string))-1 where size of string = 22 per line in input file) 
- * in 64bit OS, I knew for sure that it wouldn’t throw the overflow during the operation. I have already confirmed that storing input text file as 
- * vector of string works even for the biggest 2.6GB file given to the class.
+ * 6 bytes per record (packed date & time + temperature, see record_store.h) instead of a whole string per line,
+ * tasks address the records by index just like they did with the vector of string.
+ * The text of a record is only regenerated for the over-heating & over-cooling hours that get written to the output file.
 */
-vector<string> text_input;
+RecordStore text_input;
 
 //save stdev high and low for all months of all years
-unordered_map<string, unordered_map<string, float> > stdev_high_per_year;   //{year, {month, mean + stdev}}
-unordered_map<string, unordered_map<string, float> > stdev_low_per_year;    //{year, {month, mean - stdev}}
+//flat table indexed by year & month (see month_stats.h), a month's slot is filled in before its task is queued and only read after
+//(in index mode every task fills in the slot of its own month, and only reads that one)
+ThresholdTable month_thresholds;
 
-//use pointer(*task) bc we dont want to create a copy of it
-//each thread will perform this method to work on task
-void* execute_task(Task* task){
+//degree-hours past the thresholds (--waste, see energy_waste.h): every worker of the pool adds up its own months in its own table,
+//and the tables are merged into waste_total once the pool is done
+bool waste_enabled = false;
+vector<WasteTable> worker_waste;
+WasteTable waste_total;
+
+//index mode: the text log the month tasks read from (NULL when the first pass already read everything)
+const MappedLog* task_log = NULL;
+
+/*
+ * Index mode: read the month of a task straight from its bytes of the log, returns false if nothing in it was kept
+ * The index (see log_index.h) says where the month is, how many records it has, and what the anomaly filter's prev_temp was
+ * right before it, so the kept records are exactly the ones a full first pass keeps.
+ * Kept records go into the task's own slot of text_input (as big as the month's record count), and the thresholds into the month's own
+ * slot of the threshold table, so no two threads ever write the same thing. The month's hour summaries go into hours
+*/
+bool load_month_task(Task* task, vector<HourSummary>& hours){
+    HourSummaryBuilder hour_builder;
+    AnomalyFilter filter;
+    filter.prev_temp = task->prev_temp;
+    unsigned long idx = task->start_idx;
+
+    size_t cursor = task->byte_begin;
+    string_view line;
+    Record rec;
+    with_seasons(*task->policy, [&](const auto& seasons){
+        while (MappedLog::scan_line(task_log->data(), task->byte_end, cursor, line)){
+            if (line.empty() || !parse_record(line, rec) || !filter.accept(rec, seasons))
+                continue;
+            hour_builder.add(idx, rec);
+            text_input.set(idx, rec);
+            idx++;
+        }
+    });
+    if (idx == task->start_idx)
+        return false;
+    task->end_idx = idx - 1;
+    hours.swap(hour_builder.hours());
+
+    //mean & stdev (or median & MAD) from the temperature column of the month's slot (see month_stats.h)
+    month_thresholds.set(task->year, task->month, text_input.temp_data() + task->start_idx, idx - task->start_idx, *task->policy);
+    return true;
+}
 
+/*
+ * Check the hours of a task for over-cooling (cooling months) and over-heating (heating months), flagged hours go into res
+ * Each hour is accepted or rejected from its summary, only a flagged hour is scanned for its first record past the threshold (see hour_summary.h)
+ * With waste, the degree-hours of every hour go into it in the same loop
+ * Written for any season policy (see season_policy.h), execute_task picks the one of the task
+*/
+template <typename Policy>
+void check_task(const vector<HourSummary>& hours, const ThresholdTable& thresholds, const Policy& seasons, vector<string>& res, WasteTable* waste){
     //save previous hour to keep a track of when the hour changes from one to another
-    string prev_hour = "";
-    vector<string> res;
+    //-1 so that the first hour of the month is always checked
+    int prev_hour = -1;
 
     //indiciate when to skip. Will use to skip and read the next hour instead of reading the next second if heating or cooling has been found within that hour
     //since we want to go to next hour once we find out that current hour is over-heating or over-cooling, set a flag and skip until next hour is found
     bool skip_flag = false;
-    for (int i = task->start_idx; i <= task->end_idx; i++){
-        //using random access, retrieve each line more quickly
-        string line = text_input[i];
-
-        //using stringstream, I separate the line of string into 3 sections (in array) based on the whitespace
-        //so the line gets separated by 3 sections: date, time, and temperature
-        //Ex. "06/05/04 01:59:38 67.8" -> date, time, temperature
-        stringstream ss(line);
-        string word;
-        //index to indicate where each section of the line should be stored to an array of string named each_line
-        int idx = 0;
-        string each_line[3];
-        while(getline(ss, word, ' ')){  //separate the line into 3 segments using spaces
-            each_line[idx] = word;
-            idx++;
-        }
 
-        //find the year
-        string curr_year = each_line[0].substr(6, 2);
-        //find the month
-        string curr_month = each_line[0].substr(0, 2);
-        //find the hour
-        string curr_hour = each_line[1].substr(0, 2);
-        //current temperature
-        float curr_temp = stod(each_line[2]);
-
-        //if we're in different hours, then turn off skip flag and let the program run through each seconds of the hour
-        if (prev_hour != curr_hour){
-            skip_flag = false;
-            prev_hour = curr_hour;
-        }
-
-        //skip if heating or cooling time already found within the same hour time interval
-        if (skip_flag == true){
-            continue;
+    for (size_t h = 0; h < hours.size(); h++){
+        if (waste != NULL)
+            waste->add(hours[h], seasons.month_class(hours[h].month), hour_waste(hours[h], thresholds, seasons, text_input.temp_data()));
+        long flagged = check_hour(hours[h], thresholds, seasons, prev_hour, skip_flag, text_input.temp_data());
+        if (flagged >= 0){
+            //the text is only regenerated for the flagged record
+            res.push_back(flagged_line(text_input.line(hours[h].start_idx + flagged), hours[h], thresholds, seasons));
         }
+    }
+}
 
-        //if current month is May to August (cooling months)
-        if (curr_month == "05" || curr_month == "06" || curr_month == "07" || curr_month == "08"){
-            //check for hours when too much cooling going on by reading stdev_low_per_year using current year and current month as indices
-            if (curr_temp < stdev_low_per_year[curr_year][curr_month]){
-                res.push_back(line + " - temp too cold, one stdev lower: " + to_string(stdev_low_per_year[curr_year][curr_month]));
-                //since over-cooling hour is found, set skip flag to true
-                skip_flag = true;
-            }
-        }
-        //if current month is October to February (heating months)
-        else if (curr_month == "10" || curr_month == "11" || curr_month == "12" || curr_month == "01" || curr_month == "02"){
-            //check for hours when too much heating going on by reading stdev_high_per_year using current year and current month as indices
-            if (curr_temp > stdev_high_per_year[curr_year][curr_month]){
-                res.push_back(line + " - temp too warm, one stdev higher: " + to_string(stdev_high_per_year[curr_year][curr_month]));
-                //since over-heating hour is found, set skip flag to true
-                skip_flag = true;
-            }
+//use pointer(*task) bc we dont want to create a copy of it
+//each worker of the pool will perform this method to work on task, the degree-hours go into the worker's own waste table (NULL without --waste)
+void* execute_task(Task* task, WasteTable* waste){
+    //index mode: the month has to be read first
+    vector<HourSummary> loaded_hours;
+    if (task_log != NULL){
+        if (!load_month_task(task, loaded_hours)){
+            //nothing to write, but the months after this one are waiting for it
+            output_writer.write_in_order(task->seq, string());
+            return NULL;
         }
+        task->hours = &loaded_hours;
     }
 
-    //set mutex lock to prevent multiple threads from writing to the same file at the same time, preventing sync issues
-    pthread_mutex_lock(&mutex_file);
+    //the thresholds are only read from here on
+    const ThresholdTable& thresholds = month_thresholds;
 
-    //append to an existing file using ios_base::app
-    ofstream output_file("output_data_parallel.txt", ios_base::app);
-    if (output_file.is_open()){
-        //read the res vector where we saved all the over-cooling & over-heating temperatures
-        for (int i = 0; i < res.size(); i++){
-            output_file << res[i] << "\n";
-        }
-        //close the output file after done writing
-        output_file.close();
+    vector<string> res;
+    with_seasons(*task->policy, [&](const auto& seasons){
+        check_task(*task->hours, thresholds, seasons, res, waste);
+    });
+
+    //read the res vector where we saved all the over-cooling & over-heating temperatures
+    //the lines of the whole task are the task's own result buffer, it goes to the writer thread in one piece
+    //and the writer puts it in the file right after the month before it (see async_writer.h), so the output is in log order
+    //like serial_p1's, whichever thread finishes first
+    string lines;
+    for (size_t i = 0; i < res.size(); i++){
+        lines += res[i];
+        lines += '\n';
     }
-    //release the lock so that other threads can write to the output file now
-    pthread_mutex_unlock(&mutex_file);
+    output_writer.write_in_order(task->seq, std::move(lines));
+    return NULL;
 }
 
-//function that starts the threads and call to pick up the task from the task queue
-void *start_thread(void* args){
-
-    //thread either waits or execute the task, so it's not gonna terminate
-    while(1){
-        //since anything inside task queue = critical section, lock mutex when task queue is in use
-        pthread_mutex_lock(&mutex_queue);
-
-        Task task;
-        int found = 0;          //flag that checks the existence of task
-        //if task_count is > 0, then there's a task
-        if (task_count > 0){
-            found = 1;
-            //read the first task inside the queue
-            task = task_queue[0];
-            //since using array is faster than queue when it comes to small size, use array like queue
-            //after reading the first task of queue, shift all the elements by 1 to the left
-            for (int i = 0; i < task_count - 1; i++){
-                task_queue[i] = task_queue[i + 1];
-            }
-            //decrement the number of tasks inside the queue
-            task_count--;
-        }
-        //if reaches the end of queue (if queue is empty and there's no task_count), unlock mutex and break out -> let thread terminate
-        else{
-            pthread_mutex_unlock(&mutex_queue);
-            break;
-        }
-
-        //when queue is not in use, free mutex
-        pthread_mutex_unlock(&mutex_queue);
+//what a worker of the pool runs for every month task, with its own waste table
+void run_task(Task& task, int worker){
+    execute_task(&task, waste_enabled ? &worker_waste[worker] : NULL);
+}
 
-        //if we know that there's a task, then execute it
-        if (found == 1){
-            //execute the task here. Comes after mutex because we free mutex and then execute (execution is not a part of critical section)
-            execute_task(&task);
-        }
+/*
+ * Usage: ./data_parallel_p1 [--incremental] [--index] [--seasons <file>] [--robust] [--waste] [--threads <n>]
+ *      --incremental: carry on from "data_parallel_p1.checkpoint" (see checkpoint.h) and only read what was appended to the log since the last run.
+ *                     The output then only has the months that changed. Needs the plain text log, not the cache or a .gz
+ *      --index: make the month tasks straight from "bigw12a_log.txt.index" (see log_index.h, written by serial_p1 or convert_log_cache)
+ *               instead of a first pass over the whole log. Each thread then reads, filters and checks its own months
+ *      --seasons: read the cooling, heating & skipped months, sigma, anomaly delta and baseline from a file (see season_policy.h)
+ *      --robust: median & MAD baseline instead of mean & stdev (see robust_stats.h)
+ *      --waste: also add up the degree-hours past the thresholds per hour, day & month and write them to "output_data_parallel_waste.txt" (see energy_waste.h)
+ *      --threads: number of threads for the first pass and the month tasks, the number of hardware threads by default
+*/
+int main(int argc, char* argv[]){
+    bool incremental = false;
+    bool use_index = false;
+    string seasons_arg;
+    bool robust = false;
+    int thread_count = WorkStealingPool<Task>::default_threads();
+    for (int i = 1; i < argc; i++){
+        string arg = argv[i];
+        if (arg == "--incremental")
+            incremental = true;
+        else if (arg == "--index")
+            use_index = true;
+        else if (arg == "--seasons" && i + 1 < argc)
+            seasons_arg = argv[++i];
+        else if (arg == "--robust")
+            robust = true;
+        else if (arg == "--waste")
+            waste_enabled = true;
+        else if (arg == "--threads" && i + 1 < argc)
+            thread_count = atoi(argv[++i]);
+    }
+    if (thread_count < 1){
+        cerr << "--threads needs a number of threads >= 1\n";
+        return 1;
     }
-}
 
-int main(){
+    //season policy of this run, the default one unless --seasons is given
+    string seasons_error;
+    if (!seasons_arg.empty() && !season_policy.load(seasons_arg, seasons_error)){
+        cerr << seasons_error << "\n";
+        return 1;
+    }
+    if (robust)
+        season_policy.robust = true;
+    if (use_index && incremental){
+        cout << "--index doesn't go with --incremental, carrying on from the checkpoint instead\n";
+        use_index = false;
+    }
     
     //read input stream
     //IMPORTANT! I have changed the input text file name as "bigw12a_log.txt" from "bigw12a.log.txt" to make sure that I am giving the file as text file to the program
-    ifstream file("bigw12a_log.txt");
+    //records come from the binary cache "bigw12a_log.txt.cache" when it is up to date (see convert_log_cache), otherwise from the
+    //memory-mapped text file (see log_input.h)
+    //incremental runs and the index need byte offsets into the text log, so they never read the cache
+    const string log_filename = "bigw12a_log.txt";
+    LogInput file(log_filename, false, !incremental && !use_index);
+    if (incremental && !file.text_log().is_open()){
+        cout << "--incremental needs the plain text log, reading the whole log instead\n";
+        incremental = false;
+    }
+
+    //incremental mode: what the last run left off with, and what this run leaves for the next one
+    const string checkpoint_filename = "data_parallel_p1.checkpoint";
+    Checkpoint checkpoint;
+    FirstPassState state;
+    if (incremental){
+        MappedLog& text = file.text_log();
+        //a line the logger is still writing is left for the next run
+        text.limit(text.complete_size());
+        if (checkpoint.load(checkpoint_filename, text, season_policy)){
+            //finished months never change again, their thresholds come straight from the checkpoint
+            for (size_t i = 0; i < checkpoint.finished.size(); i++){
+                const MonthThreshold& month = checkpoint.finished[i];
+                month_thresholds.set(month.year, month.month, month.high, month.low, season_policy);
+            }
+            state.offset = checkpoint.offset;
+            state.prev_temp = checkpoint.prev_temp;
+            state.open_month = checkpoint.open_month;
+        }
+    }
 
     //create output file that I'll be writing all the over-heating and over-cooling time
-    ofstream output_file("output_data_parallel.txt");
-    //close it to save resource. Only open the output file when writing to it
-    output_file.close();
+    //it stays open on the writer thread until every task is done
+    //(at most every month the pool can have queued is waiting in the writer's reorder window)
+    if (!output_writer.open("output_data_parallel.txt", 1 << 20, ThresholdTable::YEAR_COUNT * 12)){
+        cerr << "Failed to create output_data_parallel.txt\n";
+        return 1;
+    }
 
     /*
      * **********************************************************
@@ -234,184 +312,141 @@ int main(){
      * First, read the file from the beginning until the end and find average & stdev & task
      * Process is the same as the one in serial version except that now we save tasks at the END of each month
      * 
+     * The file is cut into thread_count pieces on line boundaries and every thread parses & filters its own piece.
+     * The pieces are stitched back together in order, so text_input and the months come out exactly as if read front to back
+     * (see parallel_first_pass.h for how the anomaly filter is handled where the pieces meet)
+     * 
      * ***********************************************************
     */
    
     auto beg = std::chrono::high_resolution_clock::now();
-    if (file.is_open()){
-        string line; 
-        
-        //variables to store typical temperature of month per year
-        unordered_map<string, float> typical_temp_per_month;   //takes {month, total typical temp}
-
-        //read all the lines, find typical_temp
-        float prev_temp = 0;
-        string prev_month = "";
-        string prev_year = "";
-        //temporarily store temperatures of all the days within a specific month
-        vector<float> temp_list;
-        unsigned long month_start_idx = 0, month_end_idx = 0;
-        while(getline(file, line)){
-            //skip blank line
-            if (line == "")
-                continue;
-
-            //using stringstream, I separate the line of string into 3 sections (in array) based on the whitespace
-            //so the line gets separated by 3 sections: date, time, and temperature
-            //Ex. "06/05/04 01:59:38 67.8" -> date, time, temperature
-            stringstream ss(line);
-            string word;
-            int idx = 0;
-            //stores date, time, and temperature
-            string each_line[3];
-            while(getline(ss, word, ' ')){
-                each_line[idx] = word;
-                idx++;
-            }
-
-            //find the year
-            string curr_year = each_line[0].substr(6, 2);
-            //find month, use as index
-            string curr_month = each_line[0].substr(0, 2);
-            //current time temperature
-            float curr_temp = stod(each_line[2]);
-
-            //NOTE assume these months are the months that really don't need any heating and cooling (to save time)
-            if (curr_month == "03" || curr_month == "04" || curr_month == "09"){
-                prev_temp = 0;  //set prev temp to 0 to prevent 
-                continue;
-            }
-
-            //check for any anomalies. If exist, skip
-            //I placed prev_temp = curr_temp after this if statement so that prev_temp stays the same when anomaly happens
-            if (prev_temp + 2 < curr_temp || prev_temp - 2 > curr_temp){
-                if (prev_temp != 0)
-                    continue;
-            }
-
-            //save curr_temp as prev_temp for the future loop
-            prev_temp = curr_temp;
-
-            //after skipping anomalies & blank line, save the text input for later use
-            text_input.push_back(line);
-
-            //if saved date is different, then date has been changed. Therefore, find average (typical temp) of that month
-            if (prev_month != curr_month){
-                if (prev_month != ""){
-                    //when you find out that you're in different month, calculate standard deviation of prev month
-                    
-                    //---------find standard deviation-----------
-
-                    //average
-                    typical_temp_per_month[prev_month] = typical_temp_per_month[prev_month] / temp_list.size();
-
-                    //stdev
-                    float result_val = 0;
-                    int n = temp_list.size();
-                    for (int i = 0; i < n; i++){
-                        result_val += pow(temp_list[i] - typical_temp_per_month[prev_month], 2);
-                    }
-                    float stdev = sqrt(result_val / n);
-
-                    //-------------------------------------------
-
-                    //save one stdev higher & one stdev lower for each year, each month
-                    //so that whenever I need it, I can go to either of these 2 maps & retrieve the data that's appropriate for either heating or cooling month
-                    stdev_high_per_year[prev_year][prev_month] = typical_temp_per_month[prev_month] + stdev;
-                    stdev_low_per_year[prev_year][prev_month] = typical_temp_per_month[prev_month] - stdev;
-
-                    temp_list.clear();
-                    typical_temp_per_month.clear();
-
-                    //if the prev month and curr month are different, save indices of when prev month starts and ends
-                    month_end_idx = text_input.size() - 2;
-                    task_queue[task_count] = Task(month_start_idx, month_end_idx);
-                    //count up the task because new task is going into the task queue. Task_count also used as an index to save the task
-                    task_count++;
-                    //and then set the new month starting idx as size - 1 (because size starts from 1 and we want to use it as index of vector)
-                    month_start_idx = text_input.size() - 1;
-                }
-                //since month has changed, save curr_month to prev_month
-                prev_month = curr_month;
-
-                //if in different month, then we might be in different year as well
-                //if we're in different year or prev_year is not yet initialized, save prev_year as curr_year
-                if (prev_year != curr_year){
-                    prev_year = curr_year;
-                }
-            }
-
-            //just keep adding the temperature within the same month to find the mean when the month changes
-            typical_temp_per_month[curr_month] += curr_temp;
-            //save temp_list because we want to know the number of elements within that month using this
-            temp_list.push_back(curr_temp);
-        }
-
-        //------if reached the end of file, save the progress of the current month-------
-        //average
-        typical_temp_per_month[prev_month] = typical_temp_per_month[prev_month] / temp_list.size();
-
-        //stdev
-        float result_val = 0;
-        int n = temp_list.size();
-        for (int i = 0; i < n; i++){
-            result_val += pow(temp_list[i] - typical_temp_per_month[prev_month], 2);
-        }
-        float stdev = sqrt(result_val / n);
-
-        //save average + stdev & average - stdev to map
-        stdev_high_per_year[prev_year][prev_month] = typical_temp_per_month[prev_month] + stdev;
-        stdev_low_per_year[prev_year][prev_month] = typical_temp_per_month[prev_month] - stdev;
-
-        //also take account of the last month into task queue, saving start and end date of the last month in output file
-        month_end_idx = text_input.size() - 1;
-        task_queue[task_count] = Task(month_start_idx, month_end_idx);
-        task_count++;
-
-        file.close();
-    }
 
     /*
     ************************************************************
     *   
     * THREADS 
     * 
-    * Create 5 threads, give task (indices of when each month starts & ends to each threads) to deal with (chunk of data)
+    * Create thread_count threads (a work-stealing pool, see work_stealing_pool.h), give task (indices of when each month starts & ends to each threads) to deal with (chunk of data)
+    * The threads are up before the first pass, so a month is checked as soon as its thresholds are known: the checking overlaps with
+    * the moments step of the first pass (the last one, once the whole log was read), not with the reading itself
     * 
-    * Before the creation of threads, mutex locks that will be used to ensure that only one thread is working on the critical section must be initialized. 
-    * If the locks are not set up properly, it leads to threads accessing and modifying the same memory that is being shared at the same time, 
-    * causing the data to be lost or overwritten. During the thread creation, the thread gets created with the function that they’re assigned to work on. 
-    * In this case, it is the start_thread method that they’re calling. Then, during the thread termination, after these threads finish executing 
-    * all the tasks inside the task queue, they will break out of their wait state and call pthread_join() method to terminate. 
-    * After all the threads have been terminated, the mutex locks also has to be destroyed. 
+    * The workers of the pool call run_task for every month they get. Nothing they share is written by two of them:
+    * every month has its own slots of the record store & the threshold table, every worker its own waste table,
+    * and the output goes through the writer thread.
+    * Once the first pass is over the pool is closed, and the workers terminate after every month was checked (pool.wait() joins them).
     * 
     ************************************************************
     */
-    //threads
-    //THREAD_NUM is a defined variable
-    pthread_t ids[THREAD_NUM];
-    //initialize all the mutex locks because we're gonna use them now
-    //Mutex_queue to lock the task queue, mutex_file to lock the output file when making changes to them
-    pthread_mutex_init(&mutex_queue, NULL);
-    pthread_mutex_init(&mutex_file, NULL);
-
-    for (int i = 0; i < THREAD_NUM; i++){
-        //read text input that is saved in vector again and check for heating and cooling using multiple threads
-        if (pthread_create(&ids[i], NULL, &start_thread, NULL) != 0 ){
-            perror("Failed to create threads");
+    worker_waste.resize(thread_count);
+    //the threads are created before there are any tasks, the first pass hands them the months as they're done
+    //the pool's queue of submitted tasks is big enough for every month of the 100 years the log's two-digit years can have
+    WorkStealingPool<Task> pool(thread_count, run_task, ThresholdTable::YEAR_COUNT * 12);
+
+    //the months of the first pass, the tasks point at their hour summaries so they're kept until the threads are done
+    //(the months handed to queue_month are the ones that end up in here, moving the vector doesn't move them)
+    vector<MonthRun> months;
+    LogIndex index;
+    if (use_index && !(file.text_log().is_open() && index.open(log_index_filename(log_filename), log_filename, season_policy))){
+        cout << "no up to date " << log_index_filename(log_filename) << ", doing the first pass instead\n";
+    }
+    if (index.is_open()){
+        /*
+         * Index mode: one task per month straight from the index, nothing is read yet
+         * Runs of hours with the same month key make up a month. Skipped months (see season_policy.h) never have a kept record so they get no task.
+         * Every month gets a slot of text_input as big as its record count
+        */
+        const vector<LogIndexEntry>& entries = index.entries();
+        unsigned long total_records = 0;
+        //the threads are already waiting, they can't start on a task before text_input has its final size, so the tasks are only queued after that
+        vector<Task> tasks;
+        size_t first = 0;
+        while (first < entries.size()){
+            uint32_t month_key = entries[first].key / HOURS_PER_MONTH;
+            size_t last = first;
+            unsigned long records = 0;
+            while (last < entries.size() && entries[last].key / HOURS_PER_MONTH == month_key){
+                records += entries[last].count;
+                last++;
+            }
+
+            Task task(total_records, 0);
+            task.year = month_key / 12;
+            task.month = month_key % 12 + 1;
+            task.byte_begin = entries[first].offset;
+            task.byte_end = index.entry_end(last - 1);
+            task.prev_temp = entries[first].prev_temp;
+            task.policy = &season_policy;
+            if (!season_policy.skipped(task.month)){
+                task.seq = tasks.size();
+                tasks.push_back(task);
+                total_records += records;
+            }
+            first = last;
+        }
+        text_input.resize(total_records);
+        task_log = &file.text_log();
+        for (size_t t = 0; t < tasks.size(); t++){
+            pool.submit(tasks[t]);
         }
     }
+    else if (file.is_open()){
+        //incremental mode: only the open month of the last run and what came after it (tasks too, so only those months are checked)
+        //every month goes to the threads as soon as the first pass has its moments
+        auto queue_month = [&pool](const MonthRun& month){
+            //save one stdev higher & one stdev lower for each year, each month, from the moments of the whole month
+            //so that whenever I need it, I can go to the table & retrieve the data that's appropriate for either heating or cooling month
+            set_thresholds(month_thresholds, month, season_policy);
+
+            //save indices of when the month starts and ends as a task
+            Task task(month.start_idx, month.end_idx);
+            task.hours = &month.hours;
+            task.policy = &season_policy;
+            //the months come from the first pass out of order, their index says where they go
+            task.seq = month.index;
+            pool.submit(task);
+        };
+        months = parallel_first_pass(file, thread_count, text_input, season_policy, incremental ? &state : NULL, queue_month);
+        //a log that couldn't be read to the end (ex. a corrupt .gz) gives no months, and no output is better than output of part of the log
+        if (file.read_failed()){
+            cerr << "Failed to read " << log_filename << ": " << file.read_error() << "\n";
+            return 1;
+        }
 
-    for (int i = 0; i < THREAD_NUM; i++){
-        //wait for threads to terminate
-        if (pthread_join(ids[i], NULL) != 0){
-            perror("Failed to join the thread");
+        //the rest of the checkpoint: how far we got, the anomaly filter state there and every month but the last one
+        if (incremental){
+            checkpoint.set_offset(file.text_log(), state.offset);
+            checkpoint.prev_temp = state.prev_temp;
+            checkpoint.open_month = state.open_month;
+            checkpoint.finished.clear();
+            for (int year = 0; year < ThresholdTable::YEAR_COUNT; year++){
+                for (int month = 1; month <= 12; month++){
+                    if (!month_thresholds.has(year, month) || (!months.empty() && year == months.back().year && month == months.back().month))
+                        continue;
+                    MonthThreshold threshold = {year, month, month_thresholds.high(year, month), month_thresholds.low(year, month)};
+                    checkpoint.finished.push_back(threshold);
+                }
+            }
         }
+
+        file.close();
+    }
+
+    //no more tasks are coming, the threads finish once every month was checked. Wait for them to terminate
+    pool.close();
+    pool.wait();
+
+    //the rest of the output, then the file is closed
+    if (!output_writer.close()){
+        cerr << "Failed to write output_data_parallel.txt\n";
     }
 
-    //destroy all the mutex locks at the end because we no longer need them
-    pthread_mutex_destroy(&mutex_queue);
-    pthread_mutex_destroy(&mutex_file);
+    //the degree-hours of all threads
+    for (size_t i = 0; i < worker_waste.size(); i++){
+        waste_total.merge(worker_waste[i]);
+    }
+
+    //index mode: the tasks read straight from the log, so it stays open until they're done
+    file.close();
 
     //measure the time
     auto end = std::chrono::high_resolution_clock::now();
@@ -424,5 +459,14 @@ int main(){
         reopen_file.close();
     }
 
+    if (waste_enabled && !waste_total.write("output_data_parallel_waste.txt")){
+        cerr << "Failed to write output_data_parallel_waste.txt\n";
+    }
+
+    //incremental mode: only once the output is written, save where this run stopped for the next one
+    if (incremental && !checkpoint.save(checkpoint_filename, season_policy)){
+        cerr << "Failed to write " << checkpoint_filename << "\n";
+    }
+
     return 0;
 }
\ No newline at end of file
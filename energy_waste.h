@@ -0,0 +1,170 @@
+#ifndef ENERGY_WASTE_H
+#define ENERGY_WASTE_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+#include "month_stats.h"
+#include "season_policy.h"
+#include "hour_summary.h"
+#include "first_exceedance.h"
+
+/*
+ * ******************************************************
+ *
+ * Energy waste: degree-hours past the thresholds, per hour, day and month
+ *
+ * The over-heating & over-cooling output only has the first record of every flagged hour, it doesn't say by how much or for how long.
+ * What gets reported is how much heating or cooling was wasted, in degree-hours: for every hour, how far its readings were past
+ * the month's threshold on average (readings within it count as 0), times the hour
+ *      cooling month:  sum(low - temp) over the readings with temp < low, / readings of the hour
+ *      heating month:  sum(temp - high) over the readings with temp > high, / readings of the hour
+ * The per-hour summaries (see hour_summary.h) already say which hours have any reading past the threshold, the others are 0 without
+ * reading them. Only those hours are read, all of them and not only up to the first flagged record. The sums are over int16 tenths, so the
+ * loop is a plain count & sum the compiler vectorizes.
+ *
+ * This runs inside the 2nd pass, on the same hours as the check (--waste). Every hour with any waste and the days they add up to are kept
+ * in a WasteTable. Each thread of data_parallel_p1 fills its own table from the months it checks, and the tables are merged once the threads
+ * are done (a reduction). write() puts the days & hours in order, so the table comes out the same no matter which thread did which month.
+ *
+ * ******************************************************
+*/
+
+//degree-hours of one hour past the threshold of its month, temps as for find_flagged() (temps[start_idx] is the hour's first reading)
+template <typename Policy>
+double hour_waste(const HourSummary& hour, const ThresholdTable& thresholds, const Policy& seasons, const int16_t* temps){
+    MonthClass month_class = seasons.month_class(hour.month);
+    const int16_t* hour_temps = temps + hour.start_idx;
+    int16_t low_bound, high_bound;
+    int64_t sum = 0;
+    uint32_t past = 0;
+    if (month_class == MONTH_COOLING){
+        float low = thresholds.low(hour.year, hour.month);
+        threshold_bounds(low, NAN, low_bound, high_bound);
+        if (hour.min_temp >= low_bound)
+            return 0;
+        for (uint32_t i = 0; i < hour.count; i++){
+            bool below = hour_temps[i] < low_bound;
+            sum += below ? hour_temps[i] : 0;
+            past += below;
+        }
+        return (past * (double)low - sum / 10.0) / hour.count;
+    }
+    if (month_class == MONTH_HEATING){
+        float high = thresholds.high(hour.year, hour.month);
+        threshold_bounds(NAN, high, low_bound, high_bound);
+        if (hour.max_temp <= high_bound)
+            return 0;
+        for (uint32_t i = 0; i < hour.count; i++){
+            bool above = hour_temps[i] > high_bound;
+            sum += above ? hour_temps[i] : 0;
+            past += above;
+        }
+        return (sum / 10.0 - past * (double)high) / hour.count;
+    }
+    return 0;
+}
+
+//degree-hours of every hour and every day that had any
+class WasteTable{
+public:
+    //add the waste of an hour (hours have to come in log order within a month)
+    void add(const HourSummary& hour, MonthClass month_class, double degree_hours){
+        if (degree_hours <= 0)
+            return;
+        HourWaste entry = {hour.year, hour.month, hour.day, hour.hour, month_class, degree_hours};
+        hours.push_back(entry);
+        if (days.empty() || days.back().year != hour.year || days.back().month != hour.month || days.back().day != hour.day){
+            DayWaste day = {hour.year, hour.month, hour.day, month_class, 0, 0, 0, 0};
+            days.push_back(day);
+        }
+        DayWaste& day = days.back();
+        day.hours++;
+        day.degree_hours += degree_hours;
+        if (degree_hours > day.peak){
+            day.peak = degree_hours;
+            day.peak_hour = hour.hour;
+        }
+    };
+
+    //take in the days of another table (ex. of another thread)
+    void merge(const WasteTable& other){
+        days.insert(days.end(), other.days.begin(), other.days.end());
+        hours.insert(hours.end(), other.hours.begin(), other.hours.end());
+    };
+
+    //write the days in order with a total after every month, then every hour in order, returns false if the file couldn't be written
+    bool write(const std::string& filename){
+        FILE* out = fopen(filename.c_str(), "w");
+        if (out == NULL)
+            return false;
+        std::stable_sort(days.begin(), days.end(), [](const DayWaste& a, const DayWaste& b){
+            return day_key(a) < day_key(b);
+        });
+        fprintf(out, "degree-hours past the thresholds per day (hours: hours with any, peak: the worst hour), and per month\n");
+        size_t d = 0;
+        while (d < days.size()){
+            //one month
+            size_t month_end = d;
+            uint32_t month_hours = 0;
+            double month_degree_hours = 0;
+            while (month_end < days.size() && days[month_end].year == days[d].year && days[month_end].month == days[d].month){
+                const DayWaste& day = days[month_end];
+                fprintf(out, "%02d/%02d/%02d  %s  hours %2u  degree-hours %9.3f  peak %7.3f at %02d:00\n",
+                        day.month, day.day, day.year, class_name(day.month_class), day.hours, day.degree_hours, day.peak, day.peak_hour);
+                month_hours += day.hours;
+                month_degree_hours += day.degree_hours;
+                month_end++;
+            }
+            fprintf(out, "%02d/%02d     %s  hours %u  degree-hours %.3f\n",
+                    days[d].month, days[d].year, class_name(days[d].month_class), month_hours, month_degree_hours);
+            d = month_end;
+        }
+
+        std::stable_sort(hours.begin(), hours.end(), [](const HourWaste& a, const HourWaste& b){
+            return hour_key(a) < hour_key(b);
+        });
+        fprintf(out, "\ndegree-hours past the thresholds per hour\n");
+        for (size_t h = 0; h < hours.size(); h++){
+            const HourWaste& hour = hours[h];
+            fprintf(out, "%02d/%02d/%02d %02d:00  %s  degree-hours %7.3f\n",
+                    hour.month, hour.day, hour.year, hour.hour, class_name(hour.month_class), hour.degree_hours);
+        }
+        return fclose(out) == 0;
+    };
+
+private:
+    struct DayWaste{
+        uint8_t year, month, day;
+        MonthClass month_class;
+        uint8_t peak_hour;
+        uint32_t hours;
+        double degree_hours;
+        double peak;
+    };
+
+    struct HourWaste{
+        uint8_t year, month, day, hour;
+        MonthClass month_class;
+        double degree_hours;
+    };
+
+    static uint32_t day_key(const DayWaste& day){
+        return (day.year * 12 + day.month - 1) * 31 + day.day - 1;
+    };
+    static uint32_t hour_key(const HourWaste& hour){
+        return ((hour.year * 12 + hour.month - 1) * 31 + hour.day - 1) * 24 + hour.hour;
+    };
+
+    static const char* class_name(MonthClass month_class){
+        return (month_class == MONTH_COOLING) ? "cooling" : "heating";
+    };
+
+    std::vector<DayWaste> days;
+    std::vector<HourWaste> hours;
+};
+
+#endif
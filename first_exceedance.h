@@ -0,0 +1,106 @@
+#ifndef FIRST_EXCEEDANCE_H
+#define FIRST_EXCEEDANCE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/*
+ * ******************************************************
+ *
+ * First record of an hour that's past a threshold
+ *
+ * Once an hour is known to be flagged (see hour_summary.h), the 2nd pass still has to find its first record with temp < low
+ * (over-cooling) or temp > high (over-heating). The temperatures of the hour are contiguous int16 (tenths of a degree), so
+ * first_exceedance() compares 16 (AVX2) or 8 (SSE2) of them against both bounds at once, turns the result into a bit mask
+ * (movemask) and stops at the first block with a bit set, the position of the lowest bit is the record.
+ * Which path runs is decided once at runtime from what the CPU supports, with a plain loop as the fallback, same as month_moments().
+ *
+ * The thresholds are floats and the old checks compared temp / 10.0f against them, so threshold_bounds() turns them into the exact
+ * int16 bounds that give the same answers: temp / 10.0f < low  <=>  temp < low_bound, and temp / 10.0f > high  <=>  temp > high_bound.
+ *
+ * ******************************************************
+*/
+
+//int16 bounds for the float thresholds (in degrees). Temperatures are int16 tenths, so bounds saturate at +-3276.7 degrees,
+//and a NaN threshold (never crossed by a float compare) gives a bound that's never crossed either
+inline void threshold_bounds(float low, float high, int16_t& low_bound, int16_t& high_bound){
+    //smallest t with !(t / 10.0f < low). t / 10.0f only grows with t, so start from the rounded guess and walk to the exact one
+    long t = std::isnan(low) ? INT16_MIN : std::lround(std::fmin(std::fmax(low * 10.0, INT16_MIN), INT16_MAX));
+    while (t > INT16_MIN && (t - 1) / 10.0f >= low)
+        t--;
+    while (t < INT16_MAX && t / 10.0f < low)
+        t++;
+    low_bound = (int16_t)t;
+
+    //largest t with !(t / 10.0f > high)
+    t = std::isnan(high) ? INT16_MAX : std::lround(std::fmin(std::fmax(high * 10.0, INT16_MIN), INT16_MAX));
+    while (t < INT16_MAX && (t + 1) / 10.0f <= high)
+        t++;
+    while (t > INT16_MIN && t / 10.0f > high)
+        t--;
+    high_bound = (int16_t)t;
+}
+
+//index of the first temps[i] < low_bound or > high_bound, count if there's none
+inline size_t first_exceedance_scalar(const int16_t* temps, size_t count, int16_t low_bound, int16_t high_bound){
+    for (size_t i = 0; i < count; i++){
+        if (temps[i] < low_bound || temps[i] > high_bound)
+            return i;
+    }
+    return count;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+inline size_t first_exceedance_sse2(const int16_t* temps, size_t count, int16_t low_bound, int16_t high_bound){
+    const __m128i low = _mm_set1_epi16(low_bound);
+    const __m128i high = _mm_set1_epi16(high_bound);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8){
+        __m128i x = _mm_loadu_si128((const __m128i*)(temps + i));
+        __m128i past = _mm_or_si128(_mm_cmplt_epi16(x, low), _mm_cmpgt_epi16(x, high));
+        //2 bits per temperature
+        unsigned mask = _mm_movemask_epi8(past);
+        if (mask != 0)
+            return i + __builtin_ctz(mask) / 2;
+    }
+    return i + first_exceedance_scalar(temps + i, count - i, low_bound, high_bound);
+}
+
+__attribute__((target("avx2")))
+inline size_t first_exceedance_avx2(const int16_t* temps, size_t count, int16_t low_bound, int16_t high_bound){
+    const __m256i low = _mm256_set1_epi16(low_bound);
+    const __m256i high = _mm256_set1_epi16(high_bound);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16){
+        __m256i x = _mm256_loadu_si256((const __m256i*)(temps + i));
+        __m256i past = _mm256_or_si256(_mm256_cmpgt_epi16(low, x), _mm256_cmpgt_epi16(x, high));
+        unsigned mask = _mm256_movemask_epi8(past);
+        if (mask != 0)
+            return i + __builtin_ctz(mask) / 2;
+    }
+    //the rest is less than a 256 bit vector, maybe one 128 bit one
+    return i + first_exceedance_sse2(temps + i, count - i, low_bound, high_bound);
+}
+#endif
+
+//the best path this CPU can run, picked on the first call
+inline size_t first_exceedance(const int16_t* temps, size_t count, int16_t low_bound, int16_t high_bound){
+    typedef size_t (*Kernel)(const int16_t*, size_t, int16_t, int16_t);
+    static const Kernel kernel = [](){
+#if defined(__x86_64__) || defined(__i386__)
+        if (__builtin_cpu_supports("avx2"))
+            return (Kernel)first_exceedance_avx2;
+        if (__builtin_cpu_supports("sse2"))
+            return (Kernel)first_exceedance_sse2;
+#endif
+        return (Kernel)first_exceedance_scalar;
+    }();
+    return kernel(temps, count, low_bound, high_bound);
+}
+
+#endif
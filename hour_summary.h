@@ -0,0 +1,122 @@
+#ifndef HOUR_SUMMARY_H
+#define HOUR_SUMMARY_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "record_parser.h"
+#include "month_stats.h"
+#include "season_policy.h"
+#include "first_exceedance.h"
+
+/*
+ * ******************************************************
+ *
+ * Per-hour summary of the kept records, built by the first pass
+ *
+ * The 2nd pass used to look at every record of an hour until one crossed the month's threshold. But whether an hour gets flagged only
+ * depends on its lowest (cooling months) or highest (heating months) temperature, so with the min & max of every hour at hand an hour
+ * is accepted or rejected with one compare. Only a flagged hour is scanned, to find its first record past the threshold, and that
+ * record can't come after the first record with the hour's min (max), so the scan stops there at the latest.
+ * The scan runs over the hour's contiguous temperatures with the SIMD search in first_exceedance.h.
+ *
+ * An hour here is a run of consecutive records with the same hour of the day and the same day, the same thing the record by record check
+ * went by (prev_hour / skip_flag carry over the rare run that is only cut by the day, ex. a gap of exactly a day), so check_hour() flags
+ * exactly the records the old loops did.
+ *
+ * ******************************************************
+*/
+struct HourSummary{
+    unsigned long start_idx;        //index of the first record of the hour (in text_input / the record store / the month's records)
+    uint32_t count;
+    uint32_t first_min, first_max;  //offsets from start_idx of the first record with the lowest & the highest temperature
+    int16_t min_temp, max_temp;     //tenths of a degree, like Record::temp
+    uint8_t year, month, day, hour;
+};
+
+//collects the summaries while the kept records go by in order
+class HourSummaryBuilder{
+public:
+    //record number idx (the next one after the last added) was kept
+    void add(unsigned long idx, const Record& rec){
+        add(idx, rec.year, rec.month, rec.day, rec.hour, rec.temp);
+    };
+
+    void add(unsigned long idx, int year, int month, int day, int hour, int16_t temp){
+        const HourSummary* last = summaries.empty() ? NULL : &summaries.back();
+        if (last == NULL || last->hour != hour || last->day != day || last->month != month || last->year != year){
+            HourSummary summary = {idx, 0, 0, 0, temp, temp, (uint8_t)year, (uint8_t)month, (uint8_t)day, (uint8_t)hour};
+            summaries.push_back(summary);
+        }
+        HourSummary& summary = summaries.back();
+        if (temp < summary.min_temp){
+            summary.min_temp = temp;
+            summary.first_min = summary.count;
+        }
+        if (temp > summary.max_temp){
+            summary.max_temp = temp;
+            summary.first_max = summary.count;
+        }
+        summary.count++;
+    };
+
+    std::vector<HourSummary>& hours(){
+        return summaries;
+    };
+
+private:
+    std::vector<HourSummary> summaries;
+};
+
+/*
+ * The record that flags the hour, as an offset from start_idx, or -1 if the hour isn't flagged
+ * temps are the temperatures (tenths) of the records the hour's indices point into (temps[start_idx] is the hour's first one),
+ * only read for flagged hours. Same answers as comparing record_temp() with the threshold record by record
+*/
+template <typename Policy>
+long find_flagged(const HourSummary& hour, const ThresholdTable& thresholds, const Policy& seasons, const int16_t* temps){
+    MonthClass month_class = seasons.month_class(hour.month);
+    if (month_class != MONTH_COOLING && month_class != MONTH_HEATING)
+        return -1;
+    int16_t low_bound, high_bound;
+    if (month_class == MONTH_COOLING){
+        threshold_bounds(thresholds.low(hour.year, hour.month), NAN, low_bound, high_bound);
+        if (hour.min_temp >= low_bound)
+            return -1;
+        return first_exceedance(temps + hour.start_idx, hour.first_min + 1, low_bound, high_bound);
+    }
+    threshold_bounds(NAN, thresholds.high(hour.year, hour.month), low_bound, high_bound);
+    if (hour.max_temp <= high_bound)
+        return -1;
+    return first_exceedance(temps + hour.start_idx, hour.first_max + 1, low_bound, high_bound);
+}
+
+/*
+ * 2nd pass check of one hour. prev_hour & skip_flag carry over from one hour to the next just like they did from one record to the next:
+ * once an hour is flagged, the rest of it (even if it goes on into the next month) is skipped
+ * Returns the offset of the record that flags the hour, or -1
+*/
+template <typename Policy>
+long check_hour(const HourSummary& hour, const ThresholdTable& thresholds, const Policy& seasons, int& prev_hour, bool& skip_flag, const int16_t* temps){
+    if (prev_hour != hour.hour){
+        skip_flag = false;
+        prev_hour = hour.hour;
+    }
+    if (skip_flag)
+        return -1;
+    long flagged = find_flagged(hour, thresholds, seasons, temps);
+    if (flagged >= 0)
+        skip_flag = true;
+    return flagged;
+}
+
+//output line of a flagged record of the hour
+template <typename Policy>
+std::string flagged_line(std::string_view line, const HourSummary& hour, const ThresholdTable& thresholds, const Policy& seasons){
+    if (seasons.month_class(hour.month) == MONTH_COOLING)
+        return std::string(line) + " - temp too cold, one stdev lower: " + std::to_string(thresholds.low(hour.year, hour.month));
+    return std::string(line) + " - temp too warm, one stdev higher: " + std::to_string(thresholds.high(hour.year, hour.month));
+}
+
+#endif
@@ -0,0 +1,303 @@
+#ifndef LOG_CACHE_H
+#define LOG_CACHE_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <sys/stat.h>
+#include "log_reader.h"
+#include "record_parser.h"
+#include "async_reader.h"
+#include "log_index.h"
+
+/*
+ * ******************************************************
+ *
+ * Binary columnar cache of a parsed temperature log
+ *
+ * Parsing a multi-GB text log takes most of the runtime of every program, even though the log hardly ever changes between runs.
+ * So the parsed records are written once (by convert_log_cache) into "<log>.cache" and the programs map that file instead of the text
+ * when it exists and is at least as new as the text log.
+ *
+ * File layout (native byte order, every section starts at an 8 byte boundary):
+ *      - LogCacheHeader
+ *      - timestamp column: uint32 packed timestamp per record (see pack_timestamp in record_parser.h)
+ *      - temperature column: int16 tenths of a degree per record
+ *      - month table: one LogCacheRange per run of records in the same month (key = timestamp / SECONDS_PER_MONTH)
+ *      - day table: one LogCacheRange per run of records in the same day (key = timestamp / SECONDS_PER_DAY)
+ *
+ * Records are in the same order as the lines of the text log, blank and malformed lines are left out.
+ * Loading is just an mmap, so the columns are read straight from the page cache without any parsing at all.
+ * The month & day tables are what date range runs seek with (find_days / find_months): serial_p2 reads only the days of its range,
+ * serial_p1 only the whole months of it (with the anomaly filter state at their start from the index of the log, see log_index.h).
+ *
+ * ******************************************************
+*/
+
+const char LOG_CACHE_MAGIC[8] = {'T', 'E', 'M', 'P', 'L', 'O', 'G', 'C'};
+//(version 2 caches had no month & day tables)
+const uint32_t LOG_CACHE_VERSION = 3;
+
+struct LogCacheHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    //size of the text log the cache was built from, a different size means the log changed
+    uint64_t source_size;
+    uint64_t record_count;
+    uint64_t month_count;
+    uint64_t day_count;
+    //byte offsets of each section from the start of the file
+    uint64_t timestamp_offset;
+    uint64_t temp_offset;
+    uint64_t month_offset;
+    uint64_t day_offset;
+};
+
+//a run of records that share a month (or day): records [first, first + count)
+struct LogCacheRange{
+    uint32_t key;
+    uint32_t count;
+    uint64_t first;
+};
+
+//name of the cache that belongs to a text log
+inline std::string log_cache_filename(const std::string& log_filename){
+    return log_filename + ".cache";
+}
+
+//round up to the next multiple of 8
+inline uint64_t align8(uint64_t offset){
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+//group consecutive timestamps that share timestamp / divisor into ranges
+inline std::vector<LogCacheRange> build_ranges(const std::vector<uint32_t>& timestamps, uint32_t divisor){
+    std::vector<LogCacheRange> ranges;
+    for (size_t i = 0; i < timestamps.size(); i++){
+        uint32_t key = timestamps[i] / divisor;
+        if (ranges.empty() || ranges.back().key != key){
+            LogCacheRange range = {key, 0, i};
+            ranges.push_back(range);
+        }
+        ranges.back().count++;
+    }
+    return ranges;
+}
+
+//write the columns to cache_filename, returns false if the file couldn't be written
+//the cache is written to a temporary file first and renamed, so a reader never sees half a cache
+inline bool write_log_cache(const std::string& cache_filename, uint64_t source_size, const std::vector<uint32_t>& timestamps, const std::vector<int16_t>& temps){
+    std::vector<LogCacheRange> months = build_ranges(timestamps, SECONDS_PER_MONTH);
+    std::vector<LogCacheRange> days = build_ranges(timestamps, SECONDS_PER_DAY);
+
+    LogCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LOG_CACHE_MAGIC, sizeof(header.magic));
+    header.version = LOG_CACHE_VERSION;
+    header.source_size = source_size;
+    header.record_count = timestamps.size();
+    header.month_count = months.size();
+    header.day_count = days.size();
+    header.timestamp_offset = align8(sizeof(header));
+    header.temp_offset = align8(header.timestamp_offset + timestamps.size() * sizeof(uint32_t));
+    header.month_offset = align8(header.temp_offset + temps.size() * sizeof(int16_t));
+    header.day_offset = align8(header.month_offset + months.size() * sizeof(LogCacheRange));
+
+    std::string tmp_filename = cache_filename + ".tmp";
+    FILE* out = fopen(tmp_filename.c_str(), "wb");
+    if (out == NULL)
+        return false;
+
+    //write one section at its offset, padding with zeros up to it
+    bool ok = true;
+    auto write_at = [&](uint64_t offset, const void* data, size_t bytes){
+        static const char zeros[8] = {0};
+        long pos = ftell(out);
+        if (pos < 0 || (uint64_t)pos > offset){
+            ok = false;
+            return;
+        }
+        ok = ok && fwrite(zeros, 1, offset - pos, out) == offset - pos;
+        ok = ok && (bytes == 0 || fwrite(data, 1, bytes, out) == bytes);
+    };
+    write_at(0, &header, sizeof(header));
+    write_at(header.timestamp_offset, timestamps.data(), timestamps.size() * sizeof(uint32_t));
+    write_at(header.temp_offset, temps.data(), temps.size() * sizeof(int16_t));
+    write_at(header.month_offset, months.data(), months.size() * sizeof(LogCacheRange));
+    write_at(header.day_offset, days.data(), days.size() * sizeof(LogCacheRange));
+
+    ok = (fclose(out) == 0) && ok;
+    if (!ok || rename(tmp_filename.c_str(), cache_filename.c_str()) != 0){
+        remove(tmp_filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+//parse the whole text log and write its cache, returns the number of records written (-1 on failure, ex. a .gz that can't be read to the end)
+//a compressed log ("*.gz") is decompressed on the fly, its cache then belongs to the .gz file
+//index (if given) is filled along the way with where every hour starts, only for a plain text log since a .gz has no byte offsets to seek to
+inline long long build_log_cache(const std::string& log_filename, const std::string& cache_filename, LogIndexBuilder* index = NULL){
+    struct stat st;
+    if (stat(log_filename.c_str(), &st) != 0)
+        return -1;
+    bool compressed = is_gzip_filename(log_filename);
+    MappedLog file;
+    AsyncReader gz_file;
+    if (compressed ? !gz_file.open(log_filename) : !file.open(log_filename))
+        return -1;
+
+    std::vector<uint32_t> timestamps;
+    std::vector<int16_t> temps;
+    //a canonical line is 23 bytes with its '\n', good enough to size the columns up front
+    if (!compressed){
+        timestamps.reserve(file.size() / (RECORD_WIDTH + 1) + 1);
+        temps.reserve(file.size() / (RECORD_WIDTH + 1) + 1);
+    }
+
+    std::string_view line;
+    Record rec;
+    size_t offset = 0;
+    while (compressed ? gz_file.next_line(line) : file.next_line(line)){
+        size_t line_offset = offset;
+        offset = file.tell();
+        if (line.empty() || !parse_record(line, rec))
+            continue;
+        if (index != NULL && !compressed)
+            index->add(line_offset, rec);
+        timestamps.push_back(pack_timestamp(rec));
+        temps.push_back(rec.temp);
+    }
+    //a cache of part of a corrupt .gz would look valid and be used from then on, so there's none at all
+    if (compressed && gz_file.read_failed()){
+        fprintf(stderr, "Failed to read %s: %s\n", log_filename.c_str(), gz_file.read_error().c_str());
+        return -1;
+    }
+
+    if (!write_log_cache(cache_filename, st.st_size, timestamps, temps))
+        return -1;
+    return (long long)timestamps.size();
+}
+
+/*
+ * A cache file mapped into memory
+ * The columns point straight into the mapping, so they're only valid while the LogCache is open
+*/
+class LogCache{
+public:
+    //map cache_filename if it's a valid cache of log_filename that is at least as new as the log
+    //if the text log doesn't exist anymore (ex. it was archived), the cache is all we have so it's used as is
+    bool open(const std::string& cache_filename, const std::string& log_filename){
+        close();
+        struct stat cache_st, log_st;
+        if (stat(cache_filename.c_str(), &cache_st) != 0)
+            return false;
+        bool have_log = stat(log_filename.c_str(), &log_st) == 0;
+        if (have_log && (cache_st.st_mtim.tv_sec < log_st.st_mtim.tv_sec ||
+                         (cache_st.st_mtim.tv_sec == log_st.st_mtim.tv_sec && cache_st.st_mtim.tv_nsec < log_st.st_mtim.tv_nsec)))
+            return false;
+
+        if (!file.open(cache_filename) || file.size() < sizeof(LogCacheHeader)){
+            close();
+            return false;
+        }
+        memcpy(&header, file.data(), sizeof(header));
+        if (memcmp(header.magic, LOG_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != LOG_CACHE_VERSION ||
+            (have_log && header.source_size != (uint64_t)log_st.st_size) || !sections_fit()){
+            close();
+            return false;
+        }
+        return true;
+    };
+
+    bool is_open() const{
+        return file.is_open();
+    };
+
+    void close(){
+        file.close();
+        memset(&header, 0, sizeof(header));
+    };
+
+    uint64_t record_count() const{
+        return header.record_count;
+    };
+    const uint32_t* timestamps() const{
+        return (const uint32_t*)(file.data() + header.timestamp_offset);
+    };
+    const int16_t* temps() const{
+        return (const int16_t*)(file.data() + header.temp_offset);
+    };
+
+    uint64_t month_count() const{
+        return header.month_count;
+    };
+    const LogCacheRange* months() const{
+        return (const LogCacheRange*)(file.data() + header.month_offset);
+    };
+
+    uint64_t day_count() const{
+        return header.day_count;
+    };
+    const LogCacheRange* days() const{
+        return (const LogCacheRange*)(file.data() + header.day_offset);
+    };
+
+    //records [first, end) of the days of dates, or of the whole months they're in, returns false if none of them is in the log
+    bool find_days(const DateRange& dates, uint64_t& first, uint64_t& end) const{
+        return find_range(days(), day_count(), dates.from_day, dates.to_day, first, end);
+    };
+    bool find_months(const DateRange& dates, uint64_t& first, uint64_t& end) const{
+        //a month key is the day / 31 (see pack_timestamp)
+        return find_range(months(), month_count(), dates.from_day / 31, dates.to_day / 31, first, end);
+    };
+
+    //decode record i
+    void get(uint64_t i, Record& rec) const{
+        unpack_timestamp(timestamps()[i], rec);
+        rec.temp = temps()[i];
+    };
+
+private:
+    //every section of the header is inside the file, in order and without overlapping, before any column pointer is handed out
+    //(a truncated or corrupt cache would otherwise be read past the end of the mapping)
+    bool sections_fit() const{
+        uint64_t size = file.size();
+        //counts that can't possibly fit are rejected first, so the sizes below can't overflow
+        if (header.record_count > size / (sizeof(uint32_t) + sizeof(int16_t)) ||
+            header.month_count > size / sizeof(LogCacheRange) || header.day_count > size / sizeof(LogCacheRange))
+            return false;
+        //section [offset, offset + bytes) starts at an 8 byte boundary, not before from, and ends by limit
+        auto fits = [](uint64_t offset, uint64_t bytes, uint64_t from, uint64_t limit){
+            return offset % 8 == 0 && offset >= from && offset <= limit && bytes <= limit - offset;
+        };
+        return fits(header.timestamp_offset, header.record_count * sizeof(uint32_t), sizeof(LogCacheHeader), header.temp_offset) &&
+               fits(header.temp_offset, header.record_count * sizeof(int16_t), header.timestamp_offset, header.month_offset) &&
+               fits(header.month_offset, header.month_count * sizeof(LogCacheRange), header.temp_offset, header.day_offset) &&
+               fits(header.day_offset, header.day_count * sizeof(LogCacheRange), header.month_offset, size);
+    };
+
+    //records [first, end) of the first run of ranges with a key in [first_key, last_key]
+    //same as LogIndex::find: the first range from first_key on, and every range right after it that's still in, returns false if there's none
+    static bool find_range(const LogCacheRange* ranges, uint64_t range_count, uint32_t first_key, uint32_t last_key, uint64_t& first, uint64_t& end){
+        uint64_t r = 0;
+        while (r < range_count && ranges[r].key < first_key)
+            r++;
+        if (r == range_count || ranges[r].key > last_key)
+            return false;
+        first = ranges[r].first;
+        while (r < range_count && ranges[r].key <= last_key){
+            end = ranges[r].first + ranges[r].count;
+            r++;
+        }
+        return true;
+    };
+
+    MappedLog file;
+    LogCacheHeader header = LogCacheHeader();
+};
+
+#endif
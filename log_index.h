@@ -0,0 +1,254 @@
+#ifndef LOG_INDEX_H
+#define LOG_INDEX_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <sys/stat.h>
+#include "record_parser.h"
+#include "month_stats.h"
+
+/*
+ * ******************************************************
+ *
+ * Sidecar index of a text log: where every hour of the log starts
+ *
+ * Without it, the only way to get to January 2011 is to read everything before it. The index ("<log>.index") is written as a by-product
+ * of a first pass over the text log (serial_p1, serial_p2, convert_log_cache) and has one entry per run of lines from the same hour:
+ *      - key: the hour, pack_timestamp(rec) / 3600 (see record_parser.h), so key / 24 is the day and key / (24 * 31) the month
+ *      - offset: byte offset of the first line of the hour
+ *      - count: number of valid records in the hour
+ *      - prev_temp: the state of the P1 anomaly filter (see month_stats.h) right before that line
+ * So a program can seek straight to any hour, day or month, knows how many records it will find there, and can even run the
+ * anomaly filter from there and get exactly what a full read would have kept.
+ *
+ * Like the cache, the index is only used if it's at least as new as the log and was built from a log of the same size.
+ * prev_temp depends on the season policy (skipped months, anomaly delta, see season_policy.h), so it's also only used with the same policy.
+ * The log is expected to be in time order (it's a logger's output), entries are in the order of the log.
+ *
+ * File layout (native byte order): LogIndexHeader, then the entries (LogIndexEntry each)
+ *
+ * ******************************************************
+*/
+
+const char LOG_INDEX_MAGIC[8] = {'T', 'E', 'M', 'P', 'L', 'O', 'G', 'I'};
+const uint32_t LOG_INDEX_VERSION = 1;
+const uint32_t SECONDS_PER_HOUR = 3600;
+const uint32_t HOURS_PER_MONTH = SECONDS_PER_MONTH / SECONDS_PER_HOUR;
+
+struct LogIndexHeader{
+    char magic[8];
+    uint32_t version;
+    //fingerprint of the anomaly filter part of the season policy the filter states were worked out with (0 = default)
+    uint32_t policy;
+    //size of the text log the index was built from, a different size means the log changed
+    uint64_t source_size;
+    uint64_t entry_count;
+};
+
+//one hour of the log
+struct LogIndexEntry{
+    uint32_t key;
+    uint32_t count;
+    uint64_t offset;
+    float prev_temp;
+    uint32_t reserved;
+};
+
+//a byte range of the log found with the index: lines [begin, end), record_count valid records, prev_temp = anomaly filter state at begin
+struct LogIndexRange{
+    uint64_t begin, end;
+    uint64_t record_count;
+    float prev_temp;
+};
+
+//name of the index that belongs to a text log
+inline std::string log_index_filename(const std::string& log_filename){
+    return log_filename + ".index";
+}
+
+//date given as "MM/DD/YY" (same as in the log), ex. on the command line. Only month, day and year of rec are set
+inline bool parse_date(const std::string& text, Record& rec){
+    int month, day, year;
+    char end;
+    if (sscanf(text.c_str(), "%d/%d/%d%c", &month, &day, &year, &end) != 3 || month < 1 || month > 12 || day < 1 || day > 31 || year < 0 || year > 99)
+        return false;
+    rec = Record();
+    rec.month = month;
+    rec.day = day;
+    rec.year = year;
+    return true;
+}
+
+//range of days from the command line (day = pack_timestamp / SECONDS_PER_DAY), both ends included
+struct DateRange{
+    uint32_t from_day = 0;
+    uint32_t to_day = UINT32_MAX;
+
+    //set from two "MM/DD/YY" dates, an empty one leaves that end open. Returns false if a date can't be read
+    bool set(const std::string& from, const std::string& to){
+        Record rec;
+        if (!from.empty()){
+            if (!parse_date(from, rec))
+                return false;
+            from_day = pack_timestamp(rec) / SECONDS_PER_DAY;
+        }
+        if (!to.empty()){
+            if (!parse_date(to, rec))
+                return false;
+            to_day = pack_timestamp(rec) / SECONDS_PER_DAY;
+        }
+        return true;
+    };
+
+    bool contains(const Record& rec) const{
+        uint32_t day = pack_timestamp(rec) / SECONDS_PER_DAY;
+        return day >= from_day && day <= to_day;
+    };
+
+    //index keys of the first and last hour of the range, or of the whole months the range is in
+    void hour_keys(bool whole_months, uint32_t& first_key, uint32_t& last_key) const{
+        if (whole_months){
+            first_key = from_day / 31 * HOURS_PER_MONTH;
+            last_key = (to_day == UINT32_MAX) ? UINT32_MAX : (to_day / 31 + 1) * HOURS_PER_MONTH - 1;
+        }
+        else{
+            first_key = from_day * 24;
+            last_key = (to_day == UINT32_MAX) ? UINT32_MAX : to_day * 24 + 23;
+        }
+    };
+};
+
+//collects the entries while a first pass reads the log front to back
+class LogIndexBuilder{
+public:
+    //the anomaly filter runs with the skipped months & anomaly delta of policy, and the index is stamped with them
+    explicit LogIndexBuilder(const SeasonPolicy& policy) : seasons(policy){};
+
+    //the line at offset was parsed into rec (blank and malformed lines are just left out)
+    void add(uint64_t offset, const Record& rec){
+        uint32_t key = pack_timestamp(rec) / SECONDS_PER_HOUR;
+        if (index_entries.empty() || index_entries.back().key != key){
+            LogIndexEntry entry = {key, 0, offset, filter.prev_temp, 0};
+            index_entries.push_back(entry);
+        }
+        index_entries.back().count++;
+        filter.accept(rec, seasons);
+    };
+
+    const std::vector<LogIndexEntry>& entries() const{
+        return index_entries;
+    };
+
+    //write index_filename, returns false if the file couldn't be written
+    //written to a temporary file first and renamed, so a reader never sees half an index
+    bool write(const std::string& index_filename, uint64_t source_size) const{
+        LogIndexHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, LOG_INDEX_MAGIC, sizeof(header.magic));
+        header.version = LOG_INDEX_VERSION;
+        header.policy = seasons.filter_fingerprint();
+        header.source_size = source_size;
+        header.entry_count = index_entries.size();
+
+        std::string tmp_filename = index_filename + ".tmp";
+        FILE* out = fopen(tmp_filename.c_str(), "wb");
+        if (out == NULL)
+            return false;
+        bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+                  (index_entries.empty() || fwrite(index_entries.data(), sizeof(LogIndexEntry), index_entries.size(), out) == index_entries.size());
+        ok = (fclose(out) == 0) && ok;
+        if (!ok || rename(tmp_filename.c_str(), index_filename.c_str()) != 0){
+            remove(tmp_filename.c_str());
+            return false;
+        }
+        return true;
+    };
+
+private:
+    const SeasonPolicy seasons;
+    std::vector<LogIndexEntry> index_entries;
+    AnomalyFilter filter;
+};
+
+class LogIndex{
+public:
+    //read index_filename if it's a valid index of log_filename that is at least as new as the log, built with the filter of policy
+    bool open(const std::string& index_filename, const std::string& log_filename, const SeasonPolicy& policy){
+        close();
+        struct stat index_st, log_st;
+        if (stat(index_filename.c_str(), &index_st) != 0 || stat(log_filename.c_str(), &log_st) != 0)
+            return false;
+        if (index_st.st_mtim.tv_sec < log_st.st_mtim.tv_sec ||
+            (index_st.st_mtim.tv_sec == log_st.st_mtim.tv_sec && index_st.st_mtim.tv_nsec < log_st.st_mtim.tv_nsec))
+            return false;
+
+        FILE* in = fopen(index_filename.c_str(), "rb");
+        if (in == NULL)
+            return false;
+        LogIndexHeader header;
+        bool ok = fread(&header, sizeof(header), 1, in) == 1 &&
+                  memcmp(header.magic, LOG_INDEX_MAGIC, sizeof(header.magic)) == 0 && header.version == LOG_INDEX_VERSION &&
+                  header.policy == policy.filter_fingerprint() && header.source_size == (uint64_t)log_st.st_size &&
+                  header.entry_count * sizeof(LogIndexEntry) + sizeof(header) == (uint64_t)index_st.st_size;
+        if (ok){
+            index_entries.resize(header.entry_count);
+            ok = index_entries.empty() || fread(index_entries.data(), sizeof(LogIndexEntry), index_entries.size(), in) == index_entries.size();
+        }
+        fclose(in);
+        if (!ok){
+            close();
+            return false;
+        }
+        source_size = header.source_size;
+        opened = true;
+        return true;
+    };
+
+    bool is_open() const{
+        return opened;
+    };
+
+    void close(){
+        std::vector<LogIndexEntry>().swap(index_entries);
+        source_size = 0;
+        opened = false;
+    };
+
+    const std::vector<LogIndexEntry>& entries() const{
+        return index_entries;
+    };
+
+    //byte offset where entry i ends: the start of the next entry, or the end of the log
+    uint64_t entry_end(size_t i) const{
+        return (i + 1 < index_entries.size()) ? index_entries[i + 1].offset : source_size;
+    };
+
+    //the part of the log with the hours first_key to last_key (both included), returns false if there's none
+    bool find(uint32_t first_key, uint32_t last_key, LogIndexRange& range) const{
+        size_t first = 0;
+        while (first < index_entries.size() && index_entries[first].key < first_key)
+            first++;
+        size_t last = first;
+        range.record_count = 0;
+        while (last < index_entries.size() && index_entries[last].key <= last_key){
+            range.record_count += index_entries[last].count;
+            last++;
+        }
+        if (first == last)
+            return false;
+        range.begin = index_entries[first].offset;
+        range.end = entry_end(last - 1);
+        range.prev_temp = index_entries[first].prev_temp;
+        return true;
+    };
+
+private:
+    std::vector<LogIndexEntry> index_entries;
+    uint64_t source_size = 0;
+    bool opened = false;
+};
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef LOG_INPUT_H
+#define LOG_INPUT_H
+
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include "log_reader.h"
+#include "record_parser.h"
+#include "log_cache.h"
+#include "async_reader.h"
+
+/*
+ * ******************************************************
+ *
+ * Record input shared by all the programs
+ *
+ * Opens the binary cache of the log ("<log>.cache", see log_cache.h) if there is an up to date one, and the text log otherwise.
+ * Either way the program gets the same thing: one valid Record at a time, in the order of the log.
+ * Blank and malformed lines are already skipped here, so the reading loops only see real records.
+ *
+ * current_line() gives the text of the record that was just returned. For the text log that's the line itself (a view into the mapping),
+ * for the cache it's regenerated from the record, so programs that only need numbers never pay for formatting.
+ *
+ * With async_read the text log is read by a separate I/O thread (see async_reader.h) instead of being mapped,
+ * so reading from disk overlaps with parsing. The cache is always mapped, there's nothing to parse there.
+ *
+ * Compressed logs work too: "<log>.gz" is used when the log itself isn't there (or the name already ends with ".gz").
+ * Those are always read by the I/O thread, which decompresses them on the fly.
+ *
+ * next_record() returning false means the end of the log, unless read_failed() says the log couldn't be read to the end
+ * (a disk error or a corrupt .gz, see async_reader.h). A program has to check that before it trusts anything it worked out from the records.
+ *
+ * ******************************************************
+*/
+class LogInput{
+public:
+    LogInput(){};
+    LogInput(const std::string& filename, bool async_read = false, bool use_cache = true){
+        open(filename, async_read, use_cache);
+    };
+
+    //use_cache = false always reads the text log (ex. to read it from a byte offset, which the cache doesn't know about)
+    //(a date range can be read from either: the cache has a table of its months & days, see limit_records())
+    bool open(const std::string& log_filename, bool async_read = false, bool use_cache = true){
+        close();
+        //archived logs are kept compressed, so if only "<log>.gz" is there read that
+        std::string filename = log_filename;
+        struct stat st;
+        if (stat(filename.c_str(), &st) != 0 && stat((filename + ".gz").c_str(), &st) == 0)
+            filename += ".gz";
+
+        if (use_cache && cache.open(log_cache_filename(filename), filename)){
+            cache_idx = 0;
+            cache_end = cache.record_count();
+            return true;
+        }
+        //a compressed log can't be mapped, it's decompressed by the I/O thread
+        if (async_read || is_gzip_filename(filename))
+            return async_text.open(filename);
+        return text.open(filename);
+    };
+
+    bool is_open() const{
+        return cache.is_open() || text.is_open() || async_text.is_open();
+    };
+
+    //true when the text log is read by the I/O thread (always the case for a compressed log)
+    bool reading_async() const{
+        return async_text.is_open();
+    };
+
+    //true when the records come from the binary cache instead of the text log
+    bool from_cache() const{
+        return cache.is_open();
+    };
+
+    void close(){
+        cache.close();
+        text.close();
+        async_text.close();
+        cache_idx = 0;
+        cache_end = 0;
+    };
+
+    //cache only: read just records [first, end), ex. the days of a date range (see LogCache::find_days)
+    void limit_records(uint64_t first, uint64_t end){
+        cache_end = end < cache.record_count() ? end : cache.record_count();
+        cache_idx = first < cache_end ? first : cache_end;
+    };
+
+    //direct access to whatever is open, for code that splits the log up between threads instead of reading it front to back
+    const MappedLog& text_log() const{
+        return text;
+    };
+    MappedLog& text_log(){
+        return text;
+    };
+    const LogCache& cached_log() const{
+        return cache;
+    };
+    const AsyncReader& async_log() const{
+        return async_text;
+    };
+
+    //true if the records stopped early because the log couldn't be read (only the I/O thread can fail, the cache & the text log are mapped)
+    bool read_failed() const{
+        return async_text.is_open() && async_text.read_failed();
+    };
+    //what went wrong, for the message
+    std::string read_error() const{
+        return read_failed() ? async_text.read_error() : std::string();
+    };
+
+    //read the next valid record, returns false at the end of the log (or if reading failed, see read_failed())
+    bool next_record(Record& rec){
+        if (cache.is_open()){
+            if (cache_idx >= cache_end)
+                return false;
+            cache.get(cache_idx, rec);
+            cache_idx++;
+            curr_rec = rec;
+            line_ready = false;
+            return true;
+        }
+
+        while (true){
+            //where the line starts, for the index of the log (see log_index.h)
+            line_offset = text.tell();
+            if (!(async_text.is_open() ? async_text.next_line(line) : text.next_line(line)))
+                break;
+            //skip blank lines and lines that don't look like a log record
+            if (!line.empty() && parse_record(line, rec)){
+                line_ready = true;
+                return true;
+            }
+        }
+        return false;
+    };
+
+    //byte offset in the text log of the line of the record that next_record just returned (only for the mapped text log)
+    uint64_t current_offset() const{
+        return line_offset;
+    };
+
+    //text of the record that next_record just returned
+    std::string_view current_line(){
+        if (!line_ready){
+            line = format_record(curr_rec, line_buf);
+            line_ready = true;
+        }
+        return line;
+    };
+
+private:
+    MappedLog text;
+    AsyncReader async_text;
+    LogCache cache;
+    uint64_t cache_idx = 0;
+    uint64_t cache_end = 0;
+    uint64_t line_offset = 0;
+
+    //the last record from the cache, only turned into text when current_line() asks for it
+    Record curr_rec = Record();
+    std::string_view line;
+    bool line_ready = false;
+    char line_buf[32];
+};
+
+//one line summary of where the time of a reading loop went when the text log is read by the I/O thread
+//loop_ms is how long the whole loop took: whatever wasn't spent waiting for the disk was spent parsing & processing
+inline std::string read_time_report(const LogInput& file, double loop_ms){
+    const AsyncReader& reader = file.async_log();
+    char buf[256];
+    snprintf(buf, sizeof(buf), "first pass: %.1f ms, stalled on I/O: %.1f ms, parsing & processing: %.1f ms (reader thread reading: %.1f ms)",
+             loop_ms, reader.stall_ms(), loop_ms - reader.stall_ms(), reader.read_ms());
+    return std::string(buf);
+}
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef LOG_READER_H
+#define LOG_READER_H
+
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+ * ******************************************************
+ *
+ * Zero-copy reader for the temperature logs
+ *
+ * Instead of getline() into a std::string (and then splitting that string again with stringstream), the whole input file is mapped
+ * into memory with mmap and each line is handed out as a string_view that points straight into the mapping.
+ * Nothing gets copied or allocated per line, so the parsing code can look at the bytes where they already are.
+ *
+ * The mapping is read-only and lives as long as the MappedLog object, so views must not be used after close().
+ *
+ * ******************************************************
+*/
+class MappedLog{
+public:
+    MappedLog(){};
+    MappedLog(const std::string& filename){
+        open(filename);
+    };
+    ~MappedLog(){
+        close();
+    };
+
+    //not copyable because it owns the mapping
+    MappedLog(const MappedLog&) = delete;
+    MappedLog& operator=(const MappedLog&) = delete;
+
+    bool open(const std::string& filename){
+        close();
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0){
+            ::close(fd);
+            return false;
+        }
+        file_size = st.st_size;
+
+        //mmap refuses zero-length mappings, so an empty file is simply an open file without any lines
+        if (file_size > 0){
+            void* addr = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED){
+                ::close(fd);
+                return false;
+            }
+            begin = (const char*)addr;
+            //we read the log front to back exactly once, so let the kernel read ahead aggressively
+            madvise(addr, file_size, MADV_SEQUENTIAL);
+        }
+        //the mapping stays valid after the descriptor is closed
+        ::close(fd);
+        opened = true;
+        cursor = 0;
+        end_pos = file_size;
+        return true;
+    };
+
+    bool is_open() const{
+        return opened;
+    };
+
+    void close(){
+        if (begin != NULL)
+            munmap((void*)begin, file_size);
+        begin = NULL;
+        file_size = 0;
+        cursor = 0;
+        end_pos = 0;
+        opened = false;
+    };
+
+    //hand out the next line (without '\n' or a trailing '\r') as a view into the mapping
+    //returns false once the end of the file is reached
+    bool next_line(std::string_view& line){
+        return scan_line(begin, end_pos, cursor, line);
+    };
+
+    //carry on reading from offset (the start of a line), ex. where an earlier run stopped
+    void seek(size_t offset){
+        cursor = (offset < end_pos) ? offset : end_pos;
+    };
+
+    //where the next line starts
+    size_t tell() const{
+        return cursor;
+    };
+
+    //stop reading at end instead of the end of the file
+    void limit(size_t end){
+        end_pos = (end < file_size) ? end : file_size;
+    };
+
+    //where reading stops (the end of the file unless limit() was called)
+    size_t read_end() const{
+        return end_pos;
+    };
+
+    //size of the file without an unfinished last line
+    //a log that's still being written can end in the middle of a line, which only gets its '\n' later
+    size_t complete_size() const{
+        if (file_size == 0)
+            return 0;
+        const char* last_newline = (const char*)memrchr(begin, '\n', file_size);
+        return (last_newline == NULL) ? 0 : (size_t)(last_newline - begin) + 1;
+    };
+
+    //same thing for any part of a buffer: the line that starts at cursor, and move cursor to the start of the next line
+    //this is what lets several threads each walk their own byte range of the same mapping
+    static bool scan_line(const char* data, size_t end, size_t& cursor, std::string_view& line){
+        if (cursor >= end)
+            return false;
+
+        const char* start = data + cursor;
+        size_t remaining = end - cursor;
+        const char* newline = (const char*)memchr(start, '\n', remaining);
+        size_t len = (newline == NULL) ? remaining : (size_t)(newline - start);
+
+        //skip past the '\n' as well so the next call starts on the next line
+        cursor += (newline == NULL) ? len : len + 1;
+
+        if (len > 0 && start[len - 1] == '\r')
+            len--;
+        line = std::string_view(start, len);
+        return true;
+    };
+
+    const char* data() const{
+        return begin;
+    };
+
+    size_t size() const{
+        return file_size;
+    };
+
+    //first byte after the line that contains pos (or the end of the file), used to cut the file into pieces on line boundaries
+    size_t next_line_start(size_t pos) const{
+        if (pos >= file_size)
+            return file_size;
+        const char* newline = (const char*)memchr(begin + pos, '\n', file_size - pos);
+        return (newline == NULL) ? file_size : (size_t)(newline - begin) + 1;
+    };
+
+private:
+    const char* begin = NULL;
+    size_t file_size = 0;
+    size_t cursor = 0;
+    size_t end_pos = 0;
+    bool opened = false;
+};
+
+//split a line into (up to) 3 whitespace separated sections without copying: date, time, and temperature
+//Ex. "06/05/04 01:59:38 67.8" -> fields[0] = "06/05/04", fields[1] = "01:59:38", fields[2] = "67.8"
+//returns the number of sections that were found
+inline int split_fields(std::string_view line, std::string_view fields[3]){
+    int idx = 0;
+    size_t pos = 0;
+    while (idx < 3 && pos <= line.size()){
+        size_t space = line.find(' ', pos);
+        if (space == std::string_view::npos)
+            space = line.size();
+        fields[idx] = line.substr(pos, space - pos);
+        idx++;
+        pos = space + 1;
+    }
+    return idx;
+}
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef MONTH_FINALIZER_H
+#define MONTH_FINALIZER_H
+
+#include <pthread.h>
+#include <cstdio>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "month_stats.h"
+
+/*
+ * ******************************************************
+ *
+ * Background finalization of months while the log is still being read
+ *
+ * When a month ends (the first record of the next month shows up), its mean & stdev have to be worked out before the thresholds are known.
+ * Done inline, the reading thread stops parsing while it does that. Here the reading thread just hands the month's temperatures over
+ * (submit, no copy: the vector is swapped out) and carries on with the next month, while a small pool of worker threads runs the SIMD
+ * kernel (see month_stats.h, or builds the sketch with a robust baseline, see robust_stats.h) and publishes the thresholds into the shared ThresholdTable.
+ *
+ * Every month has its own slot in the table, so a worker writing one month never touches what anyone else is reading.
+ * A log that isn't in order can submit the same month more than once (one job per run of it): those jobs are done one at a time,
+ * in the order they were submitted, so the last one wins just like it would if they were done right where they were submitted.
+ * Whoever needs the thresholds of a month (ex. to check it) asks published() or waits for it with wait(): the check of a month can start
+ * as soon as its thresholds are there, no matter how far the reading has got.
+ *
+ * ******************************************************
+*/
+class MonthFinalizer{
+public:
+    //the thresholds are worked out with the sigma & baseline of policy
+    MonthFinalizer(ThresholdTable& table, const SeasonPolicy& policy, int worker_count = 2) : thresholds(table), seasons(policy){
+        pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init(&has_job, NULL);
+        pthread_cond_init(&month_done, NULL);
+        for (int i = 0; i < worker_count; i++){
+            pthread_t id;
+            if (pthread_create(&id, NULL, &start_worker, this) != 0){
+                perror("Failed to create a finalizer thread");
+                continue;
+            }
+            workers.push_back(id);
+        }
+    };
+    ~MonthFinalizer(){
+        finish();
+        pthread_mutex_destroy(&mutex);
+        pthread_cond_destroy(&has_job);
+        pthread_cond_destroy(&month_done);
+    };
+    MonthFinalizer(const MonthFinalizer&) = delete;
+    MonthFinalizer& operator=(const MonthFinalizer&) = delete;
+
+    //month is done, work out its thresholds in the background. temps is taken over and left empty
+    void submit(int year, int month, std::vector<int16_t>& temps){
+        Job job;
+        job.year = year;
+        job.month = month;
+        job.temps.swap(temps);
+        //without any worker (couldn't create one) it's done right here
+        if (workers.empty()){
+            thresholds.set(year, month, job.temps.data(), job.temps.size(), seasons);
+            return;
+        }
+        pthread_mutex_lock(&mutex);
+        pending[slot(year, month)]++;
+        jobs.push_back(std::move(job));
+        pthread_cond_signal(&has_job);
+        pthread_mutex_unlock(&mutex);
+    };
+
+    //true if every submitted copy of the month has its thresholds in the table
+    bool published(int year, int month){
+        pthread_mutex_lock(&mutex);
+        bool done = pending[slot(year, month)] == 0;
+        pthread_mutex_unlock(&mutex);
+        return done;
+    };
+
+    //wait until the thresholds of the month are in the table
+    void wait(int year, int month){
+        pthread_mutex_lock(&mutex);
+        while (pending[slot(year, month)] != 0)
+            pthread_cond_wait(&month_done, &mutex);
+        pthread_mutex_unlock(&mutex);
+    };
+
+    //wait for every submitted month and stop the workers
+    void finish(){
+        pthread_mutex_lock(&mutex);
+        stop = true;
+        pthread_cond_broadcast(&has_job);
+        pthread_mutex_unlock(&mutex);
+        for (size_t i = 0; i < workers.size(); i++){
+            pthread_join(workers[i], NULL);
+        }
+        workers.clear();
+    };
+
+private:
+    struct Job{
+        int year, month;
+        std::vector<int16_t> temps;
+    };
+
+    static int slot(int year, int month){
+        return year * 12 + month - 1;
+    };
+
+    static void* start_worker(void* arg){
+        ((MonthFinalizer*)arg)->run_jobs();
+        return NULL;
+    };
+
+    //oldest job whose month no other worker is on right now (jobs.end() if there's none)
+    std::deque<Job>::iterator next_job(){
+        std::deque<Job>::iterator it = jobs.begin();
+        while (it != jobs.end() && running[slot(it->year, it->month)])
+            ++it;
+        return it;
+    };
+
+    //worker thread: finalize months until finish() is called and nothing is left
+    void run_jobs(){
+        pthread_mutex_lock(&mutex);
+        while (true){
+            std::deque<Job>::iterator it = next_job();
+            //the jobs left (if any) are all for months another worker is on, it signals has_job when it's done
+            while (it == jobs.end() && !(jobs.empty() && stop)){
+                pthread_cond_wait(&has_job, &mutex);
+                it = next_job();
+            }
+            if (it == jobs.end())
+                break;
+            Job job = std::move(*it);
+            jobs.erase(it);
+            int job_slot = slot(job.year, job.month);
+            running[job_slot] = true;
+            pthread_mutex_unlock(&mutex);
+
+            //the month's own slot, nobody else writes it (a later job of the same month waits for this one)
+            thresholds.set(job.year, job.month, job.temps.data(), job.temps.size(), seasons);
+
+            pthread_mutex_lock(&mutex);
+            running[job_slot] = false;
+            pending[job_slot]--;
+            pthread_cond_broadcast(&month_done);
+            //a job of the same month may be waiting for this one
+            if (pending[job_slot] != 0)
+                pthread_cond_broadcast(&has_job);
+        }
+        pthread_mutex_unlock(&mutex);
+    };
+
+    ThresholdTable& thresholds;
+    const SeasonPolicy seasons;
+    std::vector<pthread_t> workers;
+    pthread_mutex_t mutex;
+    pthread_cond_t has_job;         //signaled when a month is submitted, a repeat month can be started (or on finish)
+    pthread_cond_t month_done;      //signaled when a worker published a month
+    std::deque<Job> jobs;
+    int pending[ThresholdTable::YEAR_COUNT * 12] = {0};     //submitted but not published yet, per month
+    bool running[ThresholdTable::YEAR_COUNT * 12] = {false}; //a worker is on a job of the month, per month
+    bool stop = false;
+};
+
+#endif
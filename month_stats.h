@@ -0,0 +1,279 @@
+#ifndef MONTH_STATS_H
+#define MONTH_STATS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "record_parser.h"
+#include "season_policy.h"
+#include "robust_stats.h"
+
+/*
+ * ******************************************************
+ *
+ * Mean & standard deviation of a month of temperatures
+ *
+ * Temperatures are whole numbers of tenths of a degree (see record_parser.h), so instead of summing floats the month keeps
+ * exact integer moments: the number of readings, their sum, and the sum of their squares.
+ *      mean = sum / n
+ *      variance = (n * sum_sq - sum^2) / n^2      (population variance, same as sqrt(sum((x - mean)^2) / n) before)
+ *
+ * Because integer addition is exact, two partial months can be combined by adding their moments. That's what lets several threads
+ * each take a piece of the log and merge their results afterwards, and the result doesn't depend on how the log was split up.
+ * (n * sum_sq is computed in 128 bits, it would overflow 64 bits for a month of per-second readings.)
+ *
+ * The moments of a whole month of temperatures (a contiguous array of int16, like the temperature column of the record store) come from
+ * one SIMD kernel, month_moments(), that adds 16 (AVX2) or 8 (SSE2) temperatures at a time. Which one runs is decided once at runtime
+ * from what the CPU supports, with a plain loop as the fallback. It's all integer math, so every path gives exactly the same moments.
+ *
+ * The anomaly filter that decides which readings go into a month is here too, so everything that needs to replay it
+ * (the parallel first pass, the log index) runs the exact same thing.
+ *
+ * ******************************************************
+*/
+struct MonthMoments{
+    uint64_t count = 0;
+    int64_t sum = 0;
+    int64_t sum_sq = 0;
+
+    //add one reading, temp in tenths of a degree
+    void add(int16_t temp){
+        count++;
+        sum += temp;
+        sum_sq += (int64_t)temp * temp;
+    };
+
+    //combine with the moments of another part of the same month
+    void merge(const MonthMoments& other){
+        count += other.count;
+        sum += other.sum;
+        sum_sq += other.sum_sq;
+    };
+
+    //mean in degrees
+    double mean() const{
+        return (double)sum / count / 10.0;
+    };
+
+    //population standard deviation in degrees
+    double stdev() const{
+        __int128 numerator = (__int128)count * sum_sq - (__int128)sum * sum;
+        double variance = (double)numerator / ((double)count * count);
+        return std::sqrt(variance) / 10.0;
+    };
+};
+
+/*
+ * month_moments(): count, sum and sum of squares of temps[0, count)
+ *
+ * The vector paths use madd (multiply pairs of int16 and add the neighbouring products into int32):
+ *      - sum: madd with 1s, added up in int32 lanes. A lane grows by at most 2 * 32768 per step, so the lanes are moved into
+ *        the 64 bit total every MOMENTS_BLOCK steps, long before they could overflow
+ *      - sum of squares: madd of the temps with themselves, at most 2 * 32768^2 which still fits 32 bits unsigned,
+ *        widened to 64 bit lanes right away
+*/
+const size_t MOMENTS_BLOCK = 16384;
+
+inline MonthMoments month_moments_scalar(const int16_t* temps, size_t count){
+    MonthMoments moments;
+    for (size_t i = 0; i < count; i++){
+        moments.add(temps[i]);
+    }
+    return moments;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+inline MonthMoments month_moments_sse2(const int16_t* temps, size_t count){
+    MonthMoments moments;
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum_sq = _mm_setzero_si128();      //2 x uint64
+    size_t i = 0;
+    while (i + 8 <= count){
+        __m128i sum = _mm_setzero_si128();     //4 x int32, only for one block
+        size_t block_end = (count - i) / 8 < MOMENTS_BLOCK ? i + (count - i) / 8 * 8 : i + MOMENTS_BLOCK * 8;
+        for (; i < block_end; i += 8){
+            __m128i x = _mm_loadu_si128((const __m128i*)(temps + i));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(x, ones));
+            __m128i sq = _mm_madd_epi16(x, x);
+            sum_sq = _mm_add_epi64(sum_sq, _mm_unpacklo_epi32(sq, zero));
+            sum_sq = _mm_add_epi64(sum_sq, _mm_unpackhi_epi32(sq, zero));
+        }
+        int32_t lanes[4];
+        _mm_storeu_si128((__m128i*)lanes, sum);
+        moments.sum += (int64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+    uint64_t sq_lanes[2];
+    _mm_storeu_si128((__m128i*)sq_lanes, sum_sq);
+    moments.sum_sq += sq_lanes[0] + sq_lanes[1];
+    moments.count += i;
+    //the last few that don't fill a vector
+    moments.merge(month_moments_scalar(temps + i, count - i));
+    return moments;
+}
+
+__attribute__((target("avx2")))
+inline MonthMoments month_moments_avx2(const int16_t* temps, size_t count){
+    MonthMoments moments;
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sum_sq = _mm256_setzero_si256();   //4 x uint64
+    size_t i = 0;
+    while (i + 16 <= count){
+        __m256i sum = _mm256_setzero_si256();  //8 x int32, only for one block
+        size_t block_end = (count - i) / 16 < MOMENTS_BLOCK ? i + (count - i) / 16 * 16 : i + MOMENTS_BLOCK * 16;
+        for (; i < block_end; i += 16){
+            __m256i x = _mm256_loadu_si256((const __m256i*)(temps + i));
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(x, ones));
+            __m256i sq = _mm256_madd_epi16(x, x);
+            sum_sq = _mm256_add_epi64(sum_sq, _mm256_unpacklo_epi32(sq, zero));
+            sum_sq = _mm256_add_epi64(sum_sq, _mm256_unpackhi_epi32(sq, zero));
+        }
+        int32_t lanes[8];
+        _mm256_storeu_si256((__m256i*)lanes, sum);
+        for (int k = 0; k < 8; k++){
+            moments.sum += lanes[k];
+        }
+    }
+    uint64_t sq_lanes[4];
+    _mm256_storeu_si256((__m256i*)sq_lanes, sum_sq);
+    moments.sum_sq += sq_lanes[0] + sq_lanes[1] + sq_lanes[2] + sq_lanes[3];
+    moments.count += i;
+    //the last few that don't fill a vector
+    moments.merge(month_moments_scalar(temps + i, count - i));
+    return moments;
+}
+#endif
+
+//the best path this CPU can run, picked on the first call
+inline MonthMoments month_moments(const int16_t* temps, size_t count){
+    typedef MonthMoments (*Kernel)(const int16_t*, size_t);
+    static const Kernel kernel = [](){
+#if defined(__x86_64__) || defined(__i386__)
+        if (__builtin_cpu_supports("avx2"))
+            return (Kernel)month_moments_avx2;
+        if (__builtin_cpu_supports("sse2"))
+            return (Kernel)month_moments_sse2;
+#endif
+        return (Kernel)month_moments_scalar;
+    }();
+    return kernel(temps, count);
+}
+
+/*
+ * Thresholds of every month (mean + stdev for heating months, mean - stdev for cooling months), looked up for every record in the 2nd pass
+ * Years are the two digits of the log (0-99), so all the months there can be fit in one flat array indexed by year * 12 + month - 1:
+ * a lookup is one multiplication and an array access, no hashing, and nothing is ever inserted, so any number of threads can read it
+ * at the same time. It's filled in once by the first pass and only read after that.
+ * A month that was never set reads as 0 for both, the same as the maps it replaces.
+*/
+class ThresholdTable{
+public:
+    static const int YEAR_COUNT = 100;
+
+    //the setters take the season policy the thresholds are for (its sigma & baseline, see season_policy.h) like the check code does,
+    //the table never looks at the policy of the run on its own
+
+    //thresholds only (ex. from a checkpoint), mean & stdev are worked back out of them with the policy's sigma
+    template <typename Policy>
+    void set(int year, int month, float high, float low, const Policy& seasons){
+        Entry& entry = entries[year * 12 + month - 1];
+        entry.high = high;
+        entry.low = low;
+        entry.mean = (high + low) / 2;
+        entry.stdev = (seasons.sigma > 0) ? (high - low) / 2 / seasons.sigma : 0;
+        entry.known = true;
+    };
+
+    //thresholds of a finished month from the moments of its temperatures, sigma stdevs away from the mean
+    template <typename Policy>
+    void set(int year, int month, const MonthMoments& moments, const Policy& seasons){
+        //average (typical temperature) & stdev of the month
+        float typical_temp = moments.mean();
+        float stdev = moments.stdev() * seasons.sigma;
+        set(year, month, typical_temp + stdev, typical_temp - stdev, seasons);
+        Entry& entry = entries[year * 12 + month - 1];
+        entry.mean = typical_temp;
+        entry.stdev = moments.stdev();
+    };
+
+    //thresholds of a finished month with a robust baseline (see robust_stats.h): median +- sigma scaled MADs
+    template <typename Policy>
+    void set(int year, int month, const TempSketch& sketch, const Policy& seasons){
+        float typical_temp = sketch.median();
+        float stdev = sketch.scaled_mad() * seasons.sigma;
+        set(year, month, typical_temp + stdev, typical_temp - stdev, seasons);
+        Entry& entry = entries[year * 12 + month - 1];
+        entry.mean = typical_temp;
+        entry.stdev = sketch.scaled_mad();
+    };
+
+    //thresholds of a finished month from its temperatures, with the baseline of the season policy
+    template <typename Policy>
+    void set(int year, int month, const int16_t* temps, size_t count, const Policy& seasons){
+        if (seasons.robust)
+            set(year, month, month_sketch(temps, count), seasons);
+        else
+            set(year, month, month_moments(temps, count), seasons);
+    };
+
+    //thresholds k stdevs away from the mean instead of sigma (at k = sigma they're exactly high() & low() for months set from moments)
+    void level(int year, int month, float k, float& high, float& low) const{
+        const Entry& entry = entries[year * 12 + month - 1];
+        float stdev = entry.stdev * k;
+        high = entry.mean + stdev;
+        low = entry.mean - stdev;
+    };
+
+    //mean + stdev of the month
+    float high(int year, int month) const{
+        return entries[year * 12 + month - 1].high;
+    };
+
+    //mean - stdev of the month
+    float low(int year, int month) const{
+        return entries[year * 12 + month - 1].low;
+    };
+
+    //true if the month was set
+    bool has(int year, int month) const{
+        return entries[year * 12 + month - 1].known;
+    };
+
+private:
+    struct Entry{
+        float high = 0;
+        float low = 0;
+        float mean = 0;
+        double stdev = 0;
+        bool known = false;
+    };
+    Entry entries[YEAR_COUNT * 12];
+};
+
+//the anomaly filter of the first pass, on its own so it can be run again from any prev_temp
+struct AnomalyFilter{
+    float prev_temp = 0;
+
+    //true if the record is kept, with the months & anomaly delta of the given policy (see season_policy.h)
+    template <typename Policy>
+    bool accept(const Record& rec, const Policy& seasons){
+        //NOTE assume the skipped months are the months that really don't need any heating and cooling (to save time)
+        if (seasons.skipped(rec.month)){
+            prev_temp = 0;
+            return false;
+        }
+        float curr_temp = record_temp(rec);
+        //anomaly, prev_temp stays the same
+        if (seasons.is_anomaly(prev_temp, curr_temp))
+            return false;
+        prev_temp = curr_temp;
+        return true;
+    };
+};
+
+#endif
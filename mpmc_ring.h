@@ -0,0 +1,129 @@
+#ifndef MPMC_RING_H
+#define MPMC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+#include <sched.h>
+
+/*
+ * ******************************************************
+ *
+ * Bounded lock-free multi-producer / multi-consumer ring of tasks
+ *
+ * The task queues of the parallel programs used to be a fixed array of 256 behind a mutex, and taking a task shifted every other task
+ * down by one while holding the lock: O(n) per task, with every thread waiting on the same lock, and a log of more than 256 months
+ * would write past the end of the array.
+ *
+ * Here every slot of a ring (size = power of 2) has a sequence number that says whose turn it is (Vyukov's bounded MPMC queue):
+ *      - push: claim the slot at tail with a compare-and-swap of tail, but only if its sequence says it's free (seq == position),
+ *        write the task, then publish it with seq = position + 1
+ *      - pop: same from head, the slot has to be published (seq == position + 1), read the task, then hand the slot back to the
+ *        producers of the next lap with seq = position + capacity
+ * Producers only contend with producers on tail, consumers with consumers on head, and a push or pop is O(1) with no lock at all.
+ * Head and tail are on their own cache lines so the two sides don't keep stealing the line from each other.
+ *
+ * pop() returns false on an empty ring right away. Threads that have to wait for more tasks still sleep on a condition variable of
+ * their own (only when the ring is empty), the ring just takes the lock out of the path of every single task.
+ * push() waits for a consumer if the ring is full. The programs size their rings for every month two-digit years can have,
+ * so that never happens there.
+ *
+ * ******************************************************
+*/
+template <typename T>
+class MpmcRing{
+public:
+    //capacity is rounded up to a power of 2
+    explicit MpmcRing(size_t capacity){
+        size_t size = 2;
+        while (size < capacity)
+            size *= 2;
+        mask = size - 1;
+        slots = std::vector<Slot>(size);
+        for (size_t i = 0; i < size; i++){
+            slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    };
+    MpmcRing(const MpmcRing&) = delete;
+    MpmcRing& operator=(const MpmcRing&) = delete;
+
+    size_t capacity() const{
+        return mask + 1;
+    };
+
+    //add a task, returns false if the ring is full
+    bool try_push(const T& value){
+        size_t pos = tail.value.load(std::memory_order_relaxed);
+        while (true){
+            Slot& slot = slots[pos & mask];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            long diff = (long)seq - (long)pos;
+            if (diff == 0){
+                //the slot is free, claim it (on failure pos is reloaded with the current tail)
+                if (tail.value.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                    slot.value = value;
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0){
+                //the consumers haven't got to the slot of the last lap yet: full
+                return false;
+            }
+            else{
+                //another producer took it, try again from the new tail
+                pos = tail.value.load(std::memory_order_relaxed);
+            }
+        }
+    };
+
+    //add a task, waits (yields) while the ring is full
+    void push(const T& value){
+        while (!try_push(value))
+            sched_yield();
+    };
+
+    //take the oldest task, returns false if there's none
+    bool pop(T& value){
+        size_t pos = head.value.load(std::memory_order_relaxed);
+        while (true){
+            Slot& slot = slots[pos & mask];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            long diff = (long)seq - (long)(pos + 1);
+            if (diff == 0){
+                if (head.value.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                    value = slot.value;
+                    slot.seq.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0){
+                //nothing published there yet: empty
+                return false;
+            }
+            else{
+                pos = head.value.load(std::memory_order_relaxed);
+            }
+        }
+    };
+
+private:
+    struct Slot{
+        std::atomic<size_t> seq;
+        T value;
+
+        Slot() : seq(0){};
+        //only so the vector can be sized in the constructor, never copied while the ring is in use
+        Slot(const Slot& other) : seq(other.seq.load(std::memory_order_relaxed)), value(other.value){};
+    };
+    struct alignas(64) Position{
+        std::atomic<size_t> value{0};
+    };
+
+    Position head;      //next slot to pop
+    Position tail;      //next slot to push
+    std::vector<Slot> slots;
+    size_t mask;
+};
+
+#endif
@@ -0,0 +1,392 @@
+#ifndef PARALLEL_FIRST_PASS_H
+#define PARALLEL_FIRST_PASS_H
+
+#include <pthread.h>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include "record_parser.h"
+#include "log_input.h"
+#include "month_stats.h"
+#include "record_store.h"
+#include "hour_summary.h"
+
+/*
+ * ******************************************************
+ *
+ * First pass of the parallel P1 programs, done by all the threads instead of only the main thread
+ *
+ * The first pass reads every record, drops March/April/September and the anomalies, keeps the records that are left for the 2nd pass,
+ * and finds the mean & stdev of every month. Done front to back this is most of the runtime, so here the log is cut into one piece per thread:
+ *      - text log: byte ranges, each moved forward to the start of a line so that no line is cut in half
+ *      - cache: ranges of record indices
+ *      - compressed log: can only be decompressed front to back, so it's read by the main thread (with the decompression on the
+ *        I/O thread, see async_reader.h) and everything after the reading still runs on all threads
+ *
+ * The tricky part is the anomaly filter. Whether a record is kept depends on prev_temp, which depends on every record before it,
+ * so a thread can't know the right prev_temp at the start of its piece. So it's done in steps:
+ *      1. (all threads) each thread parses its piece and runs the filter as if prev_temp was 0 at the start (a guess)
+ *      2. (main thread) going through the pieces in order, the filter of piece k is run again from the real prev_temp that piece k-1 ended with,
+ *         side by side with the guess. As soon as both have the same prev_temp they will make the same decisions for the rest of the piece,
+ *         so we can stop there. That's usually after the first kept record, so this step costs almost nothing.
+ *      3. (all threads) each thread turns the kept records of its piece into runs of months, then copies the kept records into the record store.
+ *         With a robust baseline each run also gets the sketch of its temperatures (see robust_stats.h) right there, from the piece's own records.
+ *         The runs are merged in order: a month that crosses into the next piece is just merged with that piece's first run (and its sketch
+ *         with that run's sketch, so a month that spans every piece is still sketched by every thread).
+ *      4. (all threads) the moments of every month are taken straight from the temperature column of the store with the SIMD kernel
+ *         (see month_stats.h), the threads take turns picking up months. The hour summaries of the month are built right after.
+ *         A month is final as soon as its moments are there, so it's handed to on_month right away (if given): the 2nd pass of that month
+ *         can start while the other threads are still working out the rest. Only this step overlaps with the 2nd pass, by then the whole
+ *         log was read (steps 1 to 3 need every piece before any month is known to be complete).
+ *
+ * The result is exactly the same as reading the log front to back, no matter how many pieces it was cut into.
+ *
+ * ******************************************************
+*/
+
+//a month of kept records: indices [start_idx, end_idx] in the record store, the moments (or with a robust baseline the sketch)
+//of their temperatures and the summary of each of its hours (see hour_summary.h, filled in by step 4, the sketch by step 3)
+struct MonthRun{
+    int year = 0, month = 0;
+    unsigned long start_idx = 0, end_idx = 0;
+    MonthMoments moments;
+    TempSketch sketch;
+    std::vector<HourSummary> hours;
+    //position among the months of this pass (on_month gets them out of order, this says where they go)
+    size_t index = 0;
+};
+
+//thresholds of a month of the first pass, from the baseline of the season policy (the one the pass ran with)
+template <typename Policy>
+void set_thresholds(ThresholdTable& thresholds, const MonthRun& month, const Policy& seasons){
+    if (seasons.robust)
+        thresholds.set(month.year, month.month, month.sketch, seasons);
+    else
+        thresholds.set(month.year, month.month, month.moments, seasons);
+}
+
+//where a first pass starts from and where it ended, so an appended log can be read on from there later (see checkpoint.h)
+struct FirstPassState{
+    size_t offset = 0;                  //byte offset in the text log, always the start of a line
+    float prev_temp = 0;                //anomaly filter state at offset
+    std::vector<Record> open_month;     //kept records of the last month, which can still get more records
+};
+
+//one piece of the log and everything a thread finds out about it
+struct FirstPassChunk{
+    //byte range of the text log or record range of the cache
+    size_t begin, end;
+
+    //step 1
+    std::vector<Record> records;
+    std::vector<char> kept;
+    float guessed_prev_temp;                //prev_temp at the end of the piece when starting from 0
+
+    //step 3
+    std::vector<MonthRun> runs;             //indices relative to the first kept record of the piece
+    unsigned long kept_count;
+    unsigned long output_offset;            //index in the record store of the first kept record of the piece
+};
+
+//run fn(0) ... fn(num_threads - 1), each on its own thread, and wait for all of them
+template <typename F>
+void run_on_threads(int num_threads, F& fn){
+    struct ThreadArg{
+        F* fn;
+        int idx;
+    };
+    auto start = [](void* arg) -> void*{
+        ThreadArg* thread_arg = (ThreadArg*)arg;
+        (*thread_arg->fn)(thread_arg->idx);
+        return NULL;
+    };
+
+    std::vector<pthread_t> ids(num_threads);
+    std::vector<ThreadArg> args(num_threads);
+    std::vector<bool> created(num_threads, false);
+    for (int i = 0; i < num_threads; i++){
+        args[i].fn = &fn;
+        args[i].idx = i;
+        if (pthread_create(&ids[i], NULL, start, &args[i]) != 0){
+            perror("Failed to create threads");
+            //do the work on this thread instead so nothing is lost
+            fn(i);
+        }
+        else{
+            created[i] = true;
+        }
+    }
+    for (int i = 0; i < num_threads; i++){
+        if (created[i] && pthread_join(ids[i], NULL) != 0){
+            perror("Failed to join the thread");
+        }
+    }
+}
+
+//step 1 for one piece: parse it and run the filter from prev_temp = 0
+template <typename Policy>
+void parse_chunk(LogInput& file, FirstPassChunk& chunk, const Policy& seasons){
+    AnomalyFilter filter;
+    Record rec;
+    if (file.reading_async()){
+        //streamed log: the one piece is the whole log
+        while (file.next_record(rec)){
+            chunk.records.push_back(rec);
+            chunk.kept.push_back(filter.accept(rec, seasons));
+        }
+    }
+    else if (file.from_cache()){
+        const LogCache& cache = file.cached_log();
+        chunk.records.reserve(chunk.end - chunk.begin);
+        chunk.kept.reserve(chunk.end - chunk.begin);
+        for (size_t i = chunk.begin; i < chunk.end; i++){
+            cache.get(i, rec);
+            chunk.records.push_back(rec);
+            chunk.kept.push_back(filter.accept(rec, seasons));
+        }
+    }
+    else{
+        const MappedLog& text = file.text_log();
+        size_t expected = (chunk.end - chunk.begin) / (RECORD_WIDTH + 1) + 1;
+        chunk.records.reserve(expected);
+        chunk.kept.reserve(expected);
+        size_t cursor = chunk.begin;
+        std::string_view line;
+        while (MappedLog::scan_line(text.data(), chunk.end, cursor, line)){
+            //skip blank lines and lines that don't look like a log record
+            if (line.empty() || !parse_record(line, rec))
+                continue;
+            chunk.records.push_back(rec);
+            chunk.kept.push_back(filter.accept(rec, seasons));
+        }
+    }
+    chunk.guessed_prev_temp = filter.prev_temp;
+}
+
+//step 2 for one piece: fix the decisions made from the guess, given the real prev_temp at the start of the piece
+//returns the real prev_temp at the end of the piece
+template <typename Policy>
+float fix_chunk(FirstPassChunk& chunk, float prev_temp, const Policy& seasons){
+    AnomalyFilter real, guess;
+    real.prev_temp = prev_temp;
+    for (size_t i = 0; i < chunk.records.size(); i++){
+        //same state from here on means same decisions, the rest of the guess is right
+        if (real.prev_temp == guess.prev_temp)
+            return chunk.guessed_prev_temp;
+        chunk.kept[i] = real.accept(chunk.records[i], seasons);
+        guess.accept(chunk.records[i], seasons);
+    }
+    return real.prev_temp;
+}
+
+//step 3 for one piece: group the kept records into months, with_sketch also sketches each of them
+inline void build_chunk_runs(FirstPassChunk& chunk, bool with_sketch){
+    unsigned long kept_idx = 0;
+    for (size_t i = 0; i < chunk.records.size(); i++){
+        if (!chunk.kept[i])
+            continue;
+        const Record& rec = chunk.records[i];
+        //a new month starts whenever the month changes, the year is the one of its first record
+        if (chunk.runs.empty() || chunk.runs.back().month != rec.month){
+            MonthRun run;
+            run.year = rec.year;
+            run.month = rec.month;
+            run.start_idx = kept_idx;
+            chunk.runs.push_back(run);
+        }
+        chunk.runs.back().end_idx = kept_idx;
+        if (with_sketch)
+            chunk.runs.back().sketch.add(rec.temp);
+        kept_idx++;
+    }
+    chunk.kept_count = kept_idx;
+}
+
+//last step for one piece: copy its kept records into their place in the record store
+inline void copy_chunk_records(FirstPassChunk& chunk, RecordStore& store){
+    unsigned long out = chunk.output_offset;
+    for (size_t i = 0; i < chunk.records.size(); i++){
+        if (!chunk.kept[i])
+            continue;
+        store.set(out, chunk.records[i]);
+        out++;
+    }
+    //the piece isn't needed anymore, give the memory back
+    std::vector<Record>().swap(chunk.records);
+    std::vector<char>().swap(chunk.kept);
+}
+
+/*
+ * Read the whole log with num_threads threads
+ * Fills store with the kept records (in the order of the log) and returns the months in order,
+ * with their indices in the store and the moments of their temperatures
+ *
+ * The anomaly filter, which months are skipped and the baseline (moments or sketch) all come from policy, the same one the caller
+ * sets the thresholds with (see set_thresholds)
+ *
+ * With a state (mapped text log only), reading starts at state->offset with the filter state and open month saved there,
+ * and state is updated to where this pass ended
+ *
+ * on_month is called for every month once its moments are in (step 4), from whichever thread worked them out (so more than one at a time,
+ * and not in order). By then the whole log was read and all the records of the store are in place
+ *
+ * If the log can't be read to the end (file.read_failed(), see log_input.h) there are no months at all, on_month is never called
+ * and the store stays empty: months made out of part of the log would look just like real ones
+*/
+inline std::vector<MonthRun> parallel_first_pass(LogInput& file, int num_threads, RecordStore& store, const SeasonPolicy& policy, FirstPassState* state = NULL,
+                                                 const std::function<void(const MonthRun&)>& on_month = nullptr){
+    std::vector<MonthRun> months;
+    if (!file.is_open() || num_threads < 1)
+        return months;
+
+    //cut the log into one piece per thread
+    std::vector<FirstPassChunk> chunks(num_threads);
+    if (file.reading_async()){
+        //a streamed log can't be cut, the first piece gets all of it and the others stay empty
+        for (int k = 0; k < num_threads; k++){
+            chunks[k].begin = 0;
+            chunks[k].end = 0;
+        }
+    }
+    else if (file.from_cache()){
+        size_t total = file.cached_log().record_count();
+        for (int k = 0; k < num_threads; k++){
+            chunks[k].begin = total * k / num_threads;
+            chunks[k].end = total * (k + 1) / num_threads;
+        }
+    }
+    else{
+        const MappedLog& text = file.text_log();
+        size_t range_begin = (state != NULL) ? state->offset : 0;
+        size_t range_end = text.read_end();
+        size_t total = (range_end > range_begin) ? range_end - range_begin : 0;
+        size_t prev_end = range_begin;
+        for (int k = 0; k < num_threads; k++){
+            chunks[k].begin = prev_end;
+            //the piece ends at the start of the first line after its share of bytes
+            chunks[k].end = (k == num_threads - 1) ? range_begin + total : text.next_line_start(range_begin + total * (k + 1) / num_threads);
+            if (chunks[k].end < chunks[k].begin)
+                chunks[k].end = chunks[k].begin;
+            prev_end = chunks[k].end;
+        }
+    }
+
+    //steps 1 & 2 run the anomaly filter on every record, so they're compiled for policy (see season_policy.h)
+    float prev_temp = with_seasons(policy, [&](const auto& seasons){
+        //1. parse every piece, guessing prev_temp = 0 at its start
+        if (file.reading_async()){
+            parse_chunk(file, chunks[0], seasons);
+        }
+        else{
+            auto parse_step = [&](int k){
+                parse_chunk(file, chunks[k], seasons);
+            };
+            run_on_threads(num_threads, parse_step);
+        }
+
+        //2. fix the guesses in order. The first piece really does start from 0 (unless we carry on from a state), so it's already right
+        float end_temp = (state != NULL) ? fix_chunk(chunks[0], state->prev_temp, seasons) : chunks[0].guessed_prev_temp;
+        for (int k = 1; k < num_threads; k++){
+            end_temp = fix_chunk(chunks[k], end_temp, seasons);
+        }
+        return end_temp;
+    });
+
+    //nothing past this point may see a truncated log, the caller tells the user
+    if (file.read_failed())
+        return months;
+
+    //3. months of every piece
+    auto runs_step = [&](int k){
+        build_chunk_runs(chunks[k], policy.robust);
+    };
+    run_on_threads(num_threads, runs_step);
+
+    //merge the months of all pieces in order and find where each piece goes in the store
+    //the open month of the state comes first, as if it had just been read
+    unsigned long total_kept = 0;
+    if (state != NULL && !state->open_month.empty()){
+        MonthRun run;
+        run.year = state->open_month[0].year;
+        run.month = state->open_month[0].month;
+        run.start_idx = 0;
+        run.end_idx = state->open_month.size() - 1;
+        if (policy.robust){
+            for (size_t i = 0; i < state->open_month.size(); i++){
+                run.sketch.add(state->open_month[i].temp);
+            }
+        }
+        months.push_back(std::move(run));
+        total_kept = state->open_month.size();
+    }
+    for (int k = 0; k < num_threads; k++){
+        FirstPassChunk& chunk = chunks[k];
+        chunk.output_offset = total_kept;
+        for (size_t r = 0; r < chunk.runs.size(); r++){
+            MonthRun& run = chunk.runs[r];
+            run.start_idx += total_kept;
+            run.end_idx += total_kept;
+            //a month that started in an earlier piece
+            if (r == 0 && !months.empty() && months.back().month == run.month){
+                months.back().end_idx = run.end_idx;
+                months.back().sketch.merge(run.sketch);
+            }
+            else{
+                months.push_back(std::move(run));
+            }
+        }
+        total_kept += chunk.kept_count;
+    }
+
+    for (size_t m = 0; m < months.size(); m++){
+        months[m].index = m;
+    }
+
+    //copy the kept records, every piece into its own part of the store
+    store.resize(total_kept);
+    if (state != NULL){
+        for (size_t i = 0; i < state->open_month.size(); i++){
+            store.set(i, state->open_month[i]);
+        }
+    }
+    auto copy_step = [&](int k){
+        copy_chunk_records(chunks[k], store);
+    };
+    run_on_threads(num_threads, copy_step);
+
+    //4. moments of every month (the sketch is already there), read in one go from the temperature column, and the summary of every hour of it
+    auto moments_step = [&](int k){
+        for (size_t m = k; m < months.size(); m += num_threads){
+            MonthRun& month = months[m];
+            if (!policy.robust)
+                month.moments = month_moments(store.temp_data() + month.start_idx, month.end_idx - month.start_idx + 1);
+            HourSummaryBuilder hour_builder;
+            for (unsigned long i = month.start_idx; i <= month.end_idx; i++){
+                hour_builder.add(i, month.year, month.month, store.day(i), store.hour(i), store.temp(i));
+            }
+            month.hours.swap(hour_builder.hours());
+            if (on_month)
+                on_month(months[m]);
+        }
+    };
+    run_on_threads(num_threads, moments_step);
+
+    //where this pass ended: the last month is the new open month
+    if (state != NULL){
+        state->offset = chunks[num_threads - 1].end;
+        state->prev_temp = prev_temp;
+        state->open_month.clear();
+        if (!months.empty()){
+            state->open_month.resize(months.back().end_idx - months.back().start_idx + 1);
+            for (size_t i = 0; i < state->open_month.size(); i++){
+                store.get(months.back().start_idx + i, state->open_month[i]);
+            }
+        }
+    }
+
+    return months;
+}
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef RECORD_PARSER_H
+#define RECORD_PARSER_H
+
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include "log_reader.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * ******************************************************
+ *
+ * Fixed-width record parser for "MM/DD/YY HH:MM:SS TT.T" lines
+ *
+ * Every line of the temperature log has the same layout, so instead of cutting it into strings with substr and converting the
+ * temperature with stod, the fields are decoded straight into small integers:
+ *      - date and time become month/day/year/hour/minute/second (uint8)
+ *      - temperature becomes tenths of a degree (int16), ex. "67.8" -> 678
+ *
+ * Fast path: a canonical line is exactly 22 characters. It is checked with two overlapping 16 byte SSE2 loads ([0,16) and [6,22)),
+ * which validates every digit and separator of the line at once, and the digit pairs are combined (tens * 10 + ones) in the same registers.
+ * Nothing past the end of the line is read, so this is safe on the last line of a memory mapped file.
+ *
+ * Slow path: anything that isn't a canonical 22 character line (3 digit temperature, negative temperature, extra spaces, ...) goes through
+ * parse_record_scalar which splits the line by whitespace and validates each field. If that also fails, the line is malformed and the
+ * caller skips it, just like a blank line.
+ *
+ * ******************************************************
+*/
+
+//width of a canonical line, ex. "06/05/04 01:59:38 67.8"
+const int RECORD_WIDTH = 22;
+
+struct Record{
+    uint8_t month, day, year;
+    uint8_t hour, minute, second;
+    //temperature in tenths of a degree
+    int16_t temp;
+};
+
+//seconds in a day and the longest month, used to pack a timestamp into 32 bits
+const uint32_t SECONDS_PER_DAY = 86400;
+const uint32_t SECONDS_PER_MONTH = 31 * SECONDS_PER_DAY;
+
+//temperature of the record in degrees, the same value stod() gave us for the text of the line
+inline float record_temp(const Record& rec){
+    return rec.temp / 10.0f;
+}
+
+//dates and times have to be in range, otherwise they can't be packed (and the line is garbage anyway)
+inline bool record_in_range(const Record& rec){
+    return rec.month >= 1 && rec.month <= 12 && rec.day >= 1 && rec.day <= 31 && rec.year <= 99 &&
+           rec.hour <= 23 && rec.minute <= 59 && rec.second <= 59;
+}
+
+/*
+ * Packed timestamp: the date and time of a record as one uint32
+ *      ((year * 12 + month - 1) * 31 + day - 1) * 86400 + second of the day
+ * The largest value (year 99, December 31st, 23:59:59) is about 3.2 billion, so it fits in 32 bits. Packed timestamps sort in time order,
+ * and dividing by 3600, 86400, or SECONDS_PER_MONTH gives a key that is unique to the hour, day, or month of the record.
+*/
+inline uint32_t pack_timestamp(const Record& rec){
+    uint32_t month_idx = rec.year * 12 + rec.month - 1;
+    return (month_idx * 31 + rec.day - 1) * SECONDS_PER_DAY + rec.hour * 3600 + rec.minute * 60 + rec.second;
+}
+
+//inverse of pack_timestamp, fills in the date and time of rec (the temperature is left alone)
+inline void unpack_timestamp(uint32_t ts, Record& rec){
+    uint32_t day_idx = ts / SECONDS_PER_DAY;
+    uint32_t sec = ts % SECONDS_PER_DAY;
+    rec.second = sec % 60;
+    rec.minute = sec / 60 % 60;
+    rec.hour = sec / 3600;
+    rec.day = day_idx % 31 + 1;
+    rec.month = day_idx / 31 % 12 + 1;
+    rec.year = day_idx / 31 / 12;
+}
+
+//write the record back as a log line, ex. "06/05/04 01:59:38 67.8"
+//buf needs room for at least 32 characters, returns a view of the text that was written
+inline std::string_view format_record(const Record& rec, char* buf){
+    const uint8_t fields[6] = {rec.month, rec.day, rec.year, rec.hour, rec.minute, rec.second};
+    const char separators[6] = {'/', '/', ' ', ':', ':', ' '};
+    char* p = buf;
+    for (int i = 0; i < 6; i++){
+        *p++ = '0' + fields[i] / 10;
+        *p++ = '0' + fields[i] % 10;
+        *p++ = separators[i];
+    }
+    int temp = rec.temp;
+    if (temp < 0){
+        *p++ = '-';
+        temp = -temp;
+    }
+    //whole degrees, then the tenths
+    char digits[8];
+    int n = 0;
+    int whole = temp / 10;
+    do{
+        digits[n++] = '0' + whole % 10;
+        whole /= 10;
+    }while (whole > 0);
+    while (n > 0)
+        *p++ = digits[--n];
+    *p++ = '.';
+    *p++ = '0' + temp % 10;
+    return std::string_view(buf, p - buf);
+}
+
+//2 digit text for a date/time field, ex. 6 -> "06" (fits in the small string buffer so it doesn't allocate)
+inline std::string two_digits(int value){
+    char buf[2] = {(char)('0' + value / 10), (char)('0' + value % 10)};
+    return std::string(buf, 2);
+}
+
+inline bool is_digit_char(char c){
+    return c >= '0' && c <= '9';
+}
+
+//decode "NN" at p, returns false if either character is not a digit
+inline bool parse_two_digits(const char* p, uint8_t& out){
+    if (!is_digit_char(p[0]) || !is_digit_char(p[1]))
+        return false;
+    out = (p[0] - '0') * 10 + (p[1] - '0');
+    return true;
+}
+
+//slow path: split by whitespace and validate each section on its own
+inline bool parse_record_scalar(std::string_view line, Record& rec){
+    std::string_view fields[3];
+    if (split_fields(line, fields) != 3)
+        return false;
+
+    std::string_view date = fields[0], time = fields[1], temp = fields[2];
+    if (date.size() != 8 || date[2] != '/' || date[5] != '/')
+        return false;
+    if (time.size() != 8 || time[2] != ':' || time[5] != ':')
+        return false;
+    if (!parse_two_digits(date.data(), rec.month) || !parse_two_digits(date.data() + 3, rec.day) || !parse_two_digits(date.data() + 6, rec.year))
+        return false;
+    if (!parse_two_digits(time.data(), rec.hour) || !parse_two_digits(time.data() + 3, rec.minute) || !parse_two_digits(time.data() + 6, rec.second))
+        return false;
+
+    //the whole temperature section has to be a number, ex. "67.8x" is rejected
+    double value = 0;
+    std::from_chars_result res = std::from_chars(temp.data(), temp.data() + temp.size(), value);
+    if (res.ec != std::errc() || res.ptr != temp.data() + temp.size())
+        return false;
+    double tenths = std::round(value * 10);
+    if (tenths < INT16_MIN || tenths > INT16_MAX)
+        return false;
+    rec.temp = (int16_t)tenths;
+    return true;
+}
+
+#if defined(__SSE2__)
+//fast path for a canonical 22 character line, p must point at 22 readable bytes
+inline bool parse_record_fixed(const char* p, Record& rec){
+    //lo covers "MM/DD/YY HH:MM:S", hi covers "YY HH:MM:SS TT.T"
+    __m128i lo = _mm_loadu_si128((const __m128i*)p);
+    __m128i hi = _mm_loadu_si128((const __m128i*)(p + 6));
+
+    //expected separators, 0 marks a position that has to be a digit
+    const __m128i lo_pattern = _mm_setr_epi8(0, 0, '/', 0, 0, '/', 0, 0, ' ', 0, 0, ':', 0, 0, ':', 0);
+    const __m128i hi_pattern = _mm_setr_epi8(0, 0, ' ', 0, 0, ':', 0, 0, ':', 0, 0, ' ', 0, 0, '.', 0);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ascii_zero = _mm_set1_epi8('0');
+    const __m128i nine = _mm_set1_epi8(9);
+
+    __m128i lo_digit_pos = _mm_cmpeq_epi8(lo_pattern, zero);
+    __m128i hi_digit_pos = _mm_cmpeq_epi8(hi_pattern, zero);
+
+    //c - '0' <= 9 (unsigned) is true only for '0'..'9'
+    __m128i lo_val = _mm_sub_epi8(lo, ascii_zero);
+    __m128i hi_val = _mm_sub_epi8(hi, ascii_zero);
+    __m128i lo_is_digit = _mm_cmpeq_epi8(_mm_max_epu8(lo_val, nine), nine);
+    __m128i hi_is_digit = _mm_cmpeq_epi8(_mm_max_epu8(hi_val, nine), nine);
+
+    //every byte has to be either a digit where a digit is expected, or exactly the expected separator
+    __m128i lo_ok = _mm_or_si128(_mm_and_si128(lo_digit_pos, lo_is_digit), _mm_andnot_si128(lo_digit_pos, _mm_cmpeq_epi8(lo, lo_pattern)));
+    __m128i hi_ok = _mm_or_si128(_mm_and_si128(hi_digit_pos, hi_is_digit), _mm_andnot_si128(hi_digit_pos, _mm_cmpeq_epi8(hi, hi_pattern)));
+    if (_mm_movemask_epi8(_mm_and_si128(lo_ok, hi_ok)) != 0xFFFF)
+        return false;
+
+    //clear the separators so they don't leak into the 16 bit shifts below, then combine each digit with the one after it:
+    //pair[i] = val[i] * 10 + val[i + 1]  (val * 10 = (val << 3) + (val << 1), fits in a byte because val <= 9)
+    lo_val = _mm_and_si128(lo_val, lo_digit_pos);
+    hi_val = _mm_and_si128(hi_val, hi_digit_pos);
+    __m128i lo_pair = _mm_add_epi8(_mm_add_epi8(_mm_slli_epi16(lo_val, 3), _mm_add_epi8(lo_val, lo_val)), _mm_srli_si128(lo_val, 1));
+    __m128i hi_pair = _mm_add_epi8(_mm_add_epi8(_mm_slli_epi16(hi_val, 3), _mm_add_epi8(hi_val, hi_val)), _mm_srli_si128(hi_val, 1));
+
+    alignas(16) uint8_t lo_bytes[16], hi_bytes[16];
+    _mm_store_si128((__m128i*)lo_bytes, lo_pair);
+    _mm_store_si128((__m128i*)hi_bytes, hi_pair);
+
+    rec.month = lo_bytes[0];
+    rec.day = lo_bytes[3];
+    rec.year = lo_bytes[6];
+    rec.hour = lo_bytes[9];
+    rec.minute = lo_bytes[12];
+    rec.second = hi_bytes[9];
+    //"TT.T": hi_bytes[12] = TT, hi_bytes[15] = T * 10 (nothing follows the last digit)
+    rec.temp = hi_bytes[12] * 10 + hi_bytes[15] / 10;
+    return true;
+}
+#else
+//same checks one character at a time for targets without SSE2
+inline bool parse_record_fixed(const char* p, Record& rec){
+    if (p[2] != '/' || p[5] != '/' || p[8] != ' ' || p[11] != ':' || p[14] != ':' || p[17] != ' ' || p[20] != '.')
+        return false;
+    uint8_t whole;
+    if (!parse_two_digits(p, rec.month) || !parse_two_digits(p + 3, rec.day) || !parse_two_digits(p + 6, rec.year) ||
+        !parse_two_digits(p + 9, rec.hour) || !parse_two_digits(p + 12, rec.minute) || !parse_two_digits(p + 15, rec.second) ||
+        !parse_two_digits(p + 18, whole) || !is_digit_char(p[21]))
+        return false;
+    rec.temp = whole * 10 + (p[21] - '0');
+    return true;
+}
+#endif
+
+//parse one line, returns false if the line is malformed
+inline bool parse_record(std::string_view line, Record& rec){
+    if (line.size() == RECORD_WIDTH && parse_record_fixed(line.data(), rec))
+        return record_in_range(rec);
+    return parse_record_scalar(line, rec) && record_in_range(rec);
+}
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef RECORD_STORE_H
+#define RECORD_STORE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "record_parser.h"
+
+/*
+ * ******************************************************
+ *
+ * Compact in-memory store of the records kept by the first pass
+ *
+ * Replaces the vector<string> text_input of the parallel programs. Instead of a whole std::string per line (32 bytes of string header
+ * plus the 22 characters of the line on the heap), every record is 6 bytes split into two arrays (struct of arrays):
+ *      - timestamps: the packed date & time of the record (see pack_timestamp in record_parser.h)
+ *      - temps: the temperature in tenths of a degree
+ * Tasks still address records by index just like they did with text_input, but a scan over a month now reads two small
+ * contiguous arrays instead of chasing a pointer per line, and nothing has to be parsed again.
+ *
+ * The text of a record is only needed for the over-heating / over-cooling hours that end up in the output,
+ * so line() regenerates it from the record for just those.
+ *
+ * ******************************************************
+*/
+class RecordStore{
+public:
+    size_t size() const{
+        return timestamps.size();
+    };
+
+    void resize(size_t count){
+        timestamps.resize(count);
+        temps.resize(count);
+    };
+
+    void clear(){
+        std::vector<uint32_t>().swap(timestamps);
+        std::vector<int16_t>().swap(temps);
+    };
+
+    void set(size_t i, const Record& rec){
+        timestamps[i] = pack_timestamp(rec);
+        temps[i] = rec.temp;
+    };
+
+    void push_back(const Record& rec){
+        timestamps.push_back(pack_timestamp(rec));
+        temps.push_back(rec.temp);
+    };
+
+    //decode record i
+    void get(size_t i, Record& rec) const{
+        unpack_timestamp(timestamps[i], rec);
+        rec.temp = temps[i];
+    };
+
+    //day of the month of record i, without decoding the rest of it
+    int day(size_t i) const{
+        return timestamps[i] / SECONDS_PER_DAY % 31 + 1;
+    };
+
+    //hour of the day of record i, without decoding the rest of it
+    int hour(size_t i) const{
+        return timestamps[i] % SECONDS_PER_DAY / 3600;
+    };
+
+    int16_t temp(size_t i) const{
+        return temps[i];
+    };
+
+    //the whole temperature column, ex. for the moments of a month (see month_stats.h)
+    const int16_t* temp_data() const{
+        return temps.data();
+    };
+
+    //text of record i, "MM/DD/YY HH:MM:SS T.T"
+    std::string line(size_t i) const{
+        Record rec;
+        get(i, rec);
+        char buf[32];
+        return std::string(format_record(rec, buf));
+    };
+
+private:
+    std::vector<uint32_t> timestamps;
+    std::vector<int16_t> temps;
+};
+
+#endif
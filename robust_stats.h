@@ -0,0 +1,133 @@
+#ifndef ROBUST_STATS_H
+#define ROBUST_STATS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+
+/*
+ * ******************************************************
+ *
+ * Robust baseline of a month: median & MAD instead of mean & stdev
+ *
+ * The anomaly filter only drops a reading that jumps more than 2 degrees from the last kept one, so a sensor that drifts off slowly
+ * (or a burst of bad readings) still goes into the month and pulls its mean and, even more, its stdev. The median and the MAD
+ * (median absolute deviation from the median) hardly move with a few bad readings, so with a robust baseline (see season_policy.h)
+ * the thresholds are
+ *      median +- sigma * 1.4826 * MAD
+ * (1.4826 * MAD is the stdev of normally distributed readings, so sigma means the same thing with either baseline).
+ *
+ * A median needs more than running sums, but temperatures are whole tenths of a degree (see record_parser.h), so a sketch of the month
+ * that keeps a count per tenth is exact and still bounded: SKETCH_BINS counters (12KB) no matter how many readings the month has.
+ * Adding a reading is one increment, about what the moments cost, and two partial months are combined by adding their counts,
+ * so like MonthMoments the pieces of a month can be worked out by different threads and merged in any order (the first pass of the
+ * parallel programs does that, see parallel_first_pass.h).
+ * Readings outside [SKETCH_LOWEST, SKETCH_HIGHEST] are counted at the nearest end, which only matters if half the month is out there.
+ *
+ * ******************************************************
+*/
+const int SKETCH_LOWEST = -1000;        //-100.0 degrees
+const int SKETCH_HIGHEST = 2000;        //200.0 degrees
+const size_t SKETCH_BINS = SKETCH_HIGHEST - SKETCH_LOWEST + 1;
+
+class TempSketch{
+public:
+    //add one reading, temp in tenths of a degree
+    void add(int16_t temp){
+        if (counts.empty())
+            counts.assign(SKETCH_BINS, 0);
+        counts[bin(temp)]++;
+        total++;
+    };
+
+    //add count readings in a row
+    void add(const int16_t* temps, size_t count){
+        if (counts.empty())
+            counts.assign(SKETCH_BINS, 0);
+        uint32_t* bins = counts.data();
+        for (size_t i = 0; i < count; i++){
+            bins[bin(temps[i])]++;
+        }
+        total += count;
+    };
+
+    //combine with the sketch of another part of the same month
+    void merge(const TempSketch& other){
+        if (other.counts.empty())
+            return;
+        if (counts.empty())
+            counts.assign(SKETCH_BINS, 0);
+        for (size_t i = 0; i < SKETCH_BINS; i++){
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+    };
+
+    uint64_t count() const{
+        return total;
+    };
+
+    //median in degrees (the mean of the 2 middle readings for an even count)
+    double median() const{
+        if (total == 0)
+            return 0;
+        return histogram_median(counts.data(), SKETCH_BINS, total, SKETCH_LOWEST) / 10.0;
+    };
+
+    //median absolute deviation from the median, in degrees
+    double mad() const{
+        if (total == 0)
+            return 0;
+        //deviations in half tenths, so a median halfway between two tenths still gives whole numbers
+        long median2 = std::lround(histogram_median(counts.data(), SKETCH_BINS, total, SKETCH_LOWEST) * 2);
+        std::vector<uint32_t> deviations(2 * SKETCH_BINS, 0);
+        for (size_t i = 0; i < SKETCH_BINS; i++){
+            if (counts[i] != 0)
+                deviations[std::labs(2 * ((long)i + SKETCH_LOWEST) - median2)] += counts[i];
+        }
+        return histogram_median(deviations.data(), deviations.size(), total, 0) / 20.0;
+    };
+
+    //stdev of normally distributed readings with the same MAD, in degrees
+    double scaled_mad() const{
+        return 1.4826 * mad();
+    };
+
+private:
+    static size_t bin(int16_t temp){
+        int t = temp < SKETCH_LOWEST ? SKETCH_LOWEST : temp > SKETCH_HIGHEST ? SKETCH_HIGHEST : temp;
+        return t - SKETCH_LOWEST;
+    };
+
+    //median of a histogram where bin i stands for the value first + i
+    static double histogram_median(const uint32_t* bins, size_t bin_count, uint64_t total, long first){
+        //0 based ranks of the 2 middle readings (the same one for an odd count)
+        uint64_t low_rank = (total - 1) / 2, high_rank = total / 2;
+        long low_value = 0;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bin_count; i++){
+            if (bins[i] == 0)
+                continue;
+            if (seen <= low_rank && low_rank < seen + bins[i])
+                low_value = first + (long)i;
+            seen += bins[i];
+            if (high_rank < seen)
+                return (low_value + first + (long)i) / 2.0;
+        }
+        return low_value;
+    };
+
+    std::vector<uint32_t> counts;       //per tenth of a degree, empty until the first reading
+    uint64_t total = 0;
+};
+
+//sketch of a whole month of temperatures (a contiguous array of int16, like the temperature column of the record store)
+inline TempSketch month_sketch(const int16_t* temps, size_t count){
+    TempSketch sketch;
+    sketch.add(temps, count);
+    return sketch;
+}
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef ROLLING_BASELINE_H
+#define ROLLING_BASELINE_H
+
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "record_parser.h"
+#include "month_stats.h"
+#include "season_policy.h"
+#include "first_exceedance.h"
+
+/*
+ * ******************************************************
+ *
+ * Rolling baseline: check every record as it's read against the mean & stdev of the last N days
+ *
+ * With the calendar month baseline a month can only be checked once it's over, since its mean & stdev need all of it.
+ * Here the baseline is the kept records of the N * 24 clock hours before the current one, so a record is checked the moment it's read.
+ * The window is a ring of per-hour moments (the same exact integer count / sum / sum of squares as MonthMoments, see month_stats.h)
+ * plus their running total:
+ *      - a record is added to the moments of its hour: O(1)
+ *      - when the hour changes, the finished hour goes into the total and the hour that fell out of the window is taken out of it.
+ *        The sums are integers so taking them out is exact, the total never drifts no matter how long it runs
+ * The thresholds only change when the hour does, so they're worked out once per hour (as int16 bounds, see first_exceedance.h)
+ * and a record costs one integer compare on top of the add. Memory is N * 24 hours of moments, however many readings there are.
+ *
+ * Same rules as the month check otherwise: the season policy says whether an hour is checked for over-cooling or over-heating,
+ * sigma stdevs away from the mean, and only the first record past the threshold of an hour is flagged.
+ * A record is only checked once the window has been filling for N full days, so the first N days of the log (and of every stretch
+ * after a gap longer than the window, ex. the skipped months) are read into the window but not flagged.
+ * (The window is always mean & stdev, --robust only changes the month baseline.)
+ *
+ * ******************************************************
+*/
+
+//hours since 01/01/2000 00:00, the years of the log being 20YY
+inline int64_t absolute_hour(const Record& rec){
+    //days since 03/01/0000 of the proleptic Gregorian calendar (March first so the leap day is the last day of a year)
+    int64_t y = 2000 + rec.year - (rec.month <= 2);
+    int64_t era_day = (153 * (rec.month + (rec.month > 2 ? -3 : 9)) + 2) / 5 + rec.day - 1;
+    int64_t days = y * 365 + y / 4 - y / 100 + y / 400 + era_day;
+    return days * 24 + rec.hour;
+}
+
+class RollingBaseline{
+public:
+    //the window is the last days * 24 hours, returns false for days <= 0
+    bool set_days(int days){
+        if (days <= 0)
+            return false;
+        window_hours = days * 24;
+        slots.assign(window_hours, MonthMoments());
+        slot_hours.assign(window_hours, -1);
+        return true;
+    };
+
+    bool enabled() const{
+        return window_hours != 0;
+    };
+
+    int days() const{
+        return window_hours / 24;
+    };
+
+    //add a kept record, returns true if it's the first record of its hour past the threshold of the window
+    template <typename Policy>
+    bool add(const Record& rec, const Policy& seasons){
+        int64_t hour = absolute_hour(rec);
+        if (hour > current_hour)
+            next_hour(hour, seasons);
+
+        //the same hour check as the month baseline: once an hour is flagged, the rest of it is skipped
+        bool flagged = false;
+        if (prev_hour != rec.hour){
+            skip_flag = false;
+            prev_hour = rec.hour;
+        }
+        if (!skip_flag && checking){
+            MonthClass month_class = seasons.month_class(rec.month);
+            flagged = (month_class == MONTH_COOLING && rec.temp < low_bound) || (month_class == MONTH_HEATING && rec.temp > high_bound);
+            skip_flag = flagged;
+        }
+        current.add(rec.temp);
+        return flagged;
+    };
+
+    //output line of a flagged record (seasons: the same policy it was added with)
+    template <typename Policy>
+    std::string flagged_line(std::string_view line, const Record& rec, const Policy& seasons) const{
+        if (seasons.month_class(rec.month) == MONTH_COOLING)
+            return std::string(line) + " - temp too cold, one stdev lower than the last " + std::to_string(days()) + " days: " + std::to_string(low);
+        return std::string(line) + " - temp too warm, one stdev higher than the last " + std::to_string(days()) + " days: " + std::to_string(high);
+    };
+
+private:
+    //the current hour is over: move it into the window, drop what's older than the window and work out the thresholds of the new hour
+    template <typename Policy>
+    void next_hour(int64_t hour, const Policy& seasons){
+        if (current.count != 0){
+            size_t slot = current_hour % window_hours;
+            drop(slot);
+            slots[slot] = current;
+            slot_hours[slot] = current_hour;
+            window.merge(current);
+        }
+        current = MonthMoments();
+        current_hour = hour;
+
+        //hours that fell out of the window. After a long gap the window empties before we get there, then there's nothing left to drop
+        int64_t window_start = hour - window_hours;
+        while (dropped_until < window_start && window.count != 0){
+            size_t slot = dropped_until % window_hours;
+            if (slot_hours[slot] == dropped_until)
+                drop(slot);
+            dropped_until++;
+        }
+        if (window.count == 0){
+            dropped_until = window_start;
+            //the window starts filling from here
+            filling_since = hour;
+        }
+
+        //check only with a full window
+        checking = hour - filling_since >= window_hours;
+        if (checking){
+            float typical_temp = window.mean();
+            float stdev = window.stdev() * seasons.sigma;
+            high = typical_temp + stdev;
+            low = typical_temp - stdev;
+            threshold_bounds(low, high, low_bound, high_bound);
+        }
+    };
+
+    //take the hour in slot out of the window
+    void drop(size_t slot){
+        if (slot_hours[slot] < 0)
+            return;
+        window.count -= slots[slot].count;
+        window.sum -= slots[slot].sum;
+        window.sum_sq -= slots[slot].sum_sq;
+        slots[slot] = MonthMoments();
+        slot_hours[slot] = -1;
+    };
+
+    int64_t window_hours = 0;
+    std::vector<MonthMoments> slots;        //moments of hour slot_hours[i], at i = hour % window_hours
+    std::vector<int64_t> slot_hours;        //-1: empty
+    MonthMoments window;                    //total of the slots
+    MonthMoments current;                   //the hour that's being read, not in the window yet
+    int64_t current_hour = INT64_MIN;
+    int64_t dropped_until = INT64_MIN;      //every hour before this one is out of the window
+    int64_t filling_since = 0;
+
+    //thresholds of the current hour
+    bool checking = false;
+    float high = 0, low = 0;
+    int16_t low_bound = 0, high_bound = 0;
+
+    //hour check, like prev_hour & skip_flag of the month check
+    int prev_hour = -1;
+    bool skip_flag = false;
+};
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef SEASON_POLICY_H
+#define SEASON_POLICY_H
+
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+/*
+ * ******************************************************
+ *
+ * Season policy: which months are checked for what, and the numbers the P1 checks use
+ *
+ * Every month of the year is in one class:
+ *      - skipped: not read at all, the anomaly filter starts over after it (default: March, April, September)
+ *      - cooling: over-cooling is checked, temp < mean - sigma * stdev (default: May to August)
+ *      - heating: over-heating is checked, temp > mean + sigma * stdev (default: October to February)
+ *      - neutral: read and counted into the month's mean & stdev, but never flagged (none by default)
+ * A record is an anomaly if it's more than anomaly_delta degrees away from the last kept one (default 2).
+ * The baseline of a month is its mean & stdev, or with a robust baseline its median & scaled MAD (see robust_stats.h).
+ *
+ * The class of a month is one lookup in a 13 entry table (index = month, 0 unused), so no chain of compares per record.
+ * DefaultSeasons is the default policy with everything known at compile time, SeasonPolicy is the same thing filled in at run time
+ * (ex. from a file for a site with another climate). Code that runs per record is written as a template over the policy and
+ * called through with_seasons(), which picks DefaultSeasons whenever the run time policy is the default one, so the default
+ * case gets the table and the numbers folded right into the loop.
+ *
+ * Seasons file (--seasons <file>), one setting per line, # starts a comment. Months that aren't listed keep their default class:
+ *      cooling 5 6 7 8
+ *      heating 10 11 12 1 2
+ *      skip 3 4 9
+ *      neutral
+ *      sigma 1
+ *      anomaly 2
+ *      baseline mean           (or median)
+ *
+ * ******************************************************
+*/
+
+enum MonthClass : uint8_t{
+    MONTH_SKIPPED = 0,
+    MONTH_NEUTRAL = 1,
+    MONTH_COOLING = 2,
+    MONTH_HEATING = 3
+};
+
+//the default policy, all compile time constants
+struct DefaultSeasons{
+    static constexpr uint8_t month_classes[13] = {
+        MONTH_SKIPPED,                                                          //(unused)
+        MONTH_HEATING, MONTH_HEATING, MONTH_SKIPPED, MONTH_SKIPPED,             //Jan - Apr
+        MONTH_COOLING, MONTH_COOLING, MONTH_COOLING, MONTH_COOLING,             //May - Aug
+        MONTH_SKIPPED, MONTH_HEATING, MONTH_HEATING, MONTH_HEATING              //Sep - Dec
+    };
+    static constexpr float sigma = 1;
+    static constexpr float anomaly_delta = 2;
+    static constexpr bool robust = false;
+
+    static MonthClass month_class(int month){
+        return (MonthClass)month_classes[month];
+    };
+    static bool skipped(int month){
+        return month_classes[month] == MONTH_SKIPPED;
+    };
+    //true if curr_temp is too far away from prev_temp (prev_temp = 0: nothing kept yet, so never)
+    static bool is_anomaly(float prev_temp, float curr_temp){
+        return (prev_temp + anomaly_delta < curr_temp || prev_temp - anomaly_delta > curr_temp) && prev_temp != 0;
+    };
+};
+
+//a policy set at run time, same interface as DefaultSeasons. Starts out as the default
+class SeasonPolicy{
+public:
+    uint8_t month_classes[13];
+    float sigma = DefaultSeasons::sigma;
+    float anomaly_delta = DefaultSeasons::anomaly_delta;
+    bool robust = DefaultSeasons::robust;       //median & MAD baseline instead of mean & stdev
+
+    SeasonPolicy(){
+        memcpy(month_classes, DefaultSeasons::month_classes, sizeof(month_classes));
+    };
+
+    MonthClass month_class(int month) const{
+        return (MonthClass)month_classes[month];
+    };
+    bool skipped(int month) const{
+        return month_classes[month] == MONTH_SKIPPED;
+    };
+    bool is_anomaly(float prev_temp, float curr_temp) const{
+        return (prev_temp + anomaly_delta < curr_temp || prev_temp - anomaly_delta > curr_temp) && prev_temp != 0;
+    };
+
+    bool is_default() const{
+        return memcmp(month_classes, DefaultSeasons::month_classes, sizeof(month_classes)) == 0 &&
+               sigma == DefaultSeasons::sigma && anomaly_delta == DefaultSeasons::anomaly_delta && robust == DefaultSeasons::robust;
+    };
+
+    //fingerprints, saved with anything that depends on the policy so it's only reused with the same one
+    //each only covers what its file depends on, so ex. a --robust run doesn't make the index look stale. 0 when that part is the default
+
+    //the whole policy: the checkpoint's thresholds (sigma, baseline), kept records (skipped months, anomaly delta) and hour check (classes)
+    uint32_t fingerprint() const{
+        if (is_default())
+            return 0;
+        uint32_t hash = FNV_BASIS;
+        mix(hash, month_classes + 1, 12);
+        mix(hash, &sigma, sizeof(sigma));
+        mix(hash, &anomaly_delta, sizeof(anomaly_delta));
+        mix(hash, &robust, sizeof(robust));
+        return (hash == 0) ? 1 : hash;
+    };
+
+    //only what the anomaly filter uses, which months are skipped and the anomaly delta: the index's record counts & filter states
+    uint32_t filter_fingerprint() const{
+        uint8_t skipped_months[12];
+        bool is_default_filter = anomaly_delta == DefaultSeasons::anomaly_delta;
+        for (int month = 1; month <= 12; month++){
+            skipped_months[month - 1] = skipped(month);
+            is_default_filter = is_default_filter && skipped(month) == DefaultSeasons::skipped(month);
+        }
+        if (is_default_filter)
+            return 0;
+        uint32_t hash = FNV_BASIS;
+        mix(hash, skipped_months, sizeof(skipped_months));
+        mix(hash, &anomaly_delta, sizeof(anomaly_delta));
+        return (hash == 0) ? 1 : hash;
+    };
+
+    //read a seasons file (see above), returns false with a message in error if it can't be read
+    bool load(const std::string& filename, std::string& error){
+        std::ifstream in(filename);
+        if (!in.is_open()){
+            error = "can't open " + filename;
+            return false;
+        }
+        SeasonPolicy policy;
+        std::string line;
+        int line_number = 0;
+        while (std::getline(in, line)){
+            line_number++;
+            size_t comment = line.find('#');
+            if (comment != std::string::npos)
+                line.erase(comment);
+            std::istringstream fields(line);
+            std::string key;
+            if (!(fields >> key))
+                continue;
+
+            bool ok = true;
+            if (key == "sigma" || key == "anomaly"){
+                float value;
+                ok = (fields >> value) && value >= 0;
+                if (ok)
+                    (key == "sigma" ? policy.sigma : policy.anomaly_delta) = value;
+            }
+            else if (key == "baseline"){
+                std::string value;
+                ok = (fields >> value) && (value == "mean" || value == "median") && fields.eof();
+                if (ok)
+                    policy.robust = (value == "median");
+            }
+            else if (key == "cooling" || key == "heating" || key == "skip" || key == "neutral"){
+                MonthClass month_class = (key == "cooling") ? MONTH_COOLING : (key == "heating") ? MONTH_HEATING :
+                                         (key == "skip") ? MONTH_SKIPPED : MONTH_NEUTRAL;
+                int month;
+                while (ok && (fields >> month)){
+                    ok = month >= 1 && month <= 12;
+                    if (ok)
+                        policy.month_classes[month] = month_class;
+                }
+                ok = ok && fields.eof();
+            }
+            else{
+                ok = false;
+            }
+            if (!ok){
+                error = filename + ":" + std::to_string(line_number) + ": can't read \"" + line + "\"";
+                return false;
+            }
+        }
+        *this = policy;
+        return true;
+    };
+
+private:
+    //FNV-1a
+    static const uint32_t FNV_BASIS = 2166136261u;
+    static void mix(uint32_t& hash, const void* data, size_t len){
+        for (size_t i = 0; i < len; i++){
+            hash = (hash ^ ((const uint8_t*)data)[i]) * 16777619u;
+        }
+    };
+};
+
+//the policy of this run, set by main (--seasons) before anything is read
+inline SeasonPolicy season_policy;
+
+//call fn with the policy as DefaultSeasons (compile time fast path) if it's the default one, as it is otherwise
+template <typename F>
+auto with_seasons(const SeasonPolicy& policy, F&& fn){
+    if (policy.is_default())
+        return fn(DefaultSeasons());
+    return fn(policy);
+}
+
+#endif
@@ -1,18 +1,126 @@
 #include <iostream>
 #include <fstream>
 #include <string>
-#include <sstream>
 #include <vector>
-#include <unordered_map>
+#include <deque>
 #include <chrono>
-#include <cmath>
+#include <string_view>
+#include "record_parser.h"
+#include "log_input.h"
+#include "month_stats.h"
+#include "checkpoint.h"
+#include "log_index.h"
+#include "month_finalizer.h"
+#include "season_policy.h"
+#include "hour_summary.h"
+#include "sigma_sweep.h"
+#include "rolling_baseline.h"
+#include "energy_waste.h"
 
 using namespace std;
 
-int main(){
+/*
+ * Usage: ./serial_p1 [--stream] [--async] [--incremental] [--from MM/DD/YY] [--to MM/DD/YY] [--seasons <file>] [--robust] [--sweep LEVELS] [--rolling DAYS] [--waste]
+ *      --stream: streaming mode, see below. Without it the whole log is read first and then checked from text_input
+ *      --async: read the text log on a separate I/O thread (see async_reader.h) and print how the first pass time splits into I/O stalls and parsing
+ *      --incremental: carry on from "serial_p1.checkpoint" (see checkpoint.h) and only read what was appended to the log since the last run.
+ *                     The output then only has the months that changed. Needs the plain text log, not the cache or a .gz
+ *      --from, --to: only write the over-heating & over-cooling hours of these days (both included, either one can be left out).
+ *                    With an up to date "bigw12a_log.txt.index" (see log_index.h) only the months of the range are read (from the text log or the cache),
+ *                    otherwise the whole log is read and the output is still cut down to the range
+ *      --seasons: read the cooling, heating & skipped months, sigma, anomaly delta and baseline from a file (see season_policy.h)
+ *      --robust: median & MAD baseline instead of mean & stdev, so outliers that get past the anomaly filter don't pull the thresholds (see robust_stats.h)
+ *      --sweep: also count the flagged hours of every month at several thresholds in the same pass, ex. --sweep 0.5,1,1.5,2
+ *               (stdevs away from the mean) and write them as a table to "output_serial_sweep.txt" (see sigma_sweep.h)
+ *      --rolling: also check every record as soon as it's read against the mean & stdev of the last DAYS days instead of its calendar month,
+ *                 and write those over-heating & over-cooling hours to "output_serial_rolling.txt" as they're found (see rolling_baseline.h)
+ *      --waste: also add up how many degree-hours every hour was past its threshold, and write them per hour, day & month to "output_serial_waste.txt"
+ *               (see energy_waste.h)
+*/
+int main(int argc, char* argv[]){
+    //streaming mode: instead of saving every valid line in text_input, keep only the records of the current month
+    //and check & write that month as soon as the next one starts. Memory then stays at one month no matter how big the log is
+    bool streaming = false;
+    bool async_read = false;
+    bool incremental = false;
+    bool robust = false;
+    bool waste_enabled = false;
+    string from_arg, to_arg, seasons_arg, sweep_arg, rolling_arg;
+    for (int i = 1; i < argc; i++){
+        string arg = argv[i];
+        if (arg == "--stream")
+            streaming = true;
+        else if (arg == "--async")
+            async_read = true;
+        else if (arg == "--incremental")
+            incremental = true;
+        else if (arg == "--from" && i + 1 < argc)
+            from_arg = argv[++i];
+        else if (arg == "--to" && i + 1 < argc)
+            to_arg = argv[++i];
+        else if (arg == "--seasons" && i + 1 < argc)
+            seasons_arg = argv[++i];
+        else if (arg == "--robust")
+            robust = true;
+        else if (arg == "--sweep" && i + 1 < argc)
+            sweep_arg = argv[++i];
+        else if (arg == "--rolling" && i + 1 < argc)
+            rolling_arg = argv[++i];
+        else if (arg == "--waste")
+            waste_enabled = true;
+    }
+
+    //season policy of this run, the default one unless --seasons is given
+    string seasons_error;
+    if (!seasons_arg.empty() && !season_policy.load(seasons_arg, seasons_error)){
+        cerr << seasons_error << "\n";
+        return 1;
+    }
+    if (robust)
+        season_policy.robust = true;
+
+    //flagged hour counts at several thresholds (--sweep), none without it
+    SigmaSweep sweep;
+    if (!sweep_arg.empty() && !sweep.set_levels(sweep_arg)){
+        cerr << "--sweep needs a list of stdevs like 0.5,1,1.5,2\n";
+        return 1;
+    }
+
+    //rolling N-day baseline (--rolling), none without it
+    RollingBaseline rolling;
+    if (!rolling_arg.empty() && !rolling.set_days(atoi(rolling_arg.c_str()))){
+        cerr << "--rolling needs a number of days like 7\n";
+        return 1;
+    }
+
+    //date range of the output (see log_index.h), without --from / --to everything is in range
+    bool ranged = !from_arg.empty() || !to_arg.empty();
+    DateRange dates;
+    if (!dates.set(from_arg, to_arg)){
+        cerr << "--from and --to need a date like 01/31/11 (MM/DD/YY)\n";
+        return 1;
+    }
+    if (ranged && incremental){
+        cout << "--incremental doesn't go with a date range, reading the range instead\n";
+        incremental = false;
+    }
+    //the window of the rolling baseline isn't saved in the checkpoint
+    if (rolling.enabled() && incremental){
+        cout << "--rolling doesn't go with --incremental, reading the whole log instead\n";
+        incremental = false;
+    }
+
     //Input file to read (Using file version A, the smallest file)
     //IMPORTANT! I have changed the input text file name as "bigw12a_log.txt" from "bigw12a.log.txt" to make sure that I am giving the file as text file to the program
-    ifstream file("bigw12a_log.txt");
+    //records come from the binary cache "bigw12a_log.txt.cache" when it is up to date (see convert_log_cache), otherwise from the
+    //memory-mapped text file (see log_input.h), or the text file read by an I/O thread with --async
+    //incremental runs need byte offsets into the text log, so they never read the cache
+    const string log_filename = "bigw12a_log.txt";
+    LogInput file(log_filename, async_read && !incremental && !ranged, !incremental);
+    if (incremental && !file.text_log().is_open()){
+        cout << "--incremental needs the plain text log, reading the whole log instead\n";
+        incremental = false;
+    }
 
     /*
     *************************************************
@@ -23,6 +131,7 @@ int main(){
     * I have decided cooling months as: May, June, July, August
     * I have decided heating months as: October, November, December, January, February
     * March, April, and September are not considered and therefore, ignored
+    * (that's the default season policy, --seasons changes it, see season_policy.h)
     * 
     * Note on how I decided to find over-heating and over-cooling:
     * I first read the whole month, find typical temperature (average) of that month and its standard deviation, and save them in map.
@@ -30,15 +139,18 @@ int main(){
     * Then in the 2nd run with vector of string, I use this average with stdev to determine over-cooling & over-heating status of each hour by comparing each temperature
     * with what's in the map depending on what month we're currently in (only for either cooling or heating month)
     * 
+    * Streaming mode (--stream) does the same thing one month at a time: only the records of the current month are kept (as compact Records),
+    * and since the mean & stdev of a month are known as soon as the next month starts, that month is checked and written right then.
+    * 
     *************************************************
     */
     //save stdev high and low for all months of all years
     //the intent is to save both one stdev high & one stdev low from typical temperature (mean) and depending on the month, 
     //either check one stdev higher or lower to make the process simple
-    //I decided to use unoredered map of unordered map to save year and its corresponding month that takes O(1) time complexity to search for the data
-    //so it saves one stdev higher & lower for all year, all month
-    unordered_map<string, unordered_map<string, float> > stdev_high_per_year;   //{year, {month, mean + stdev}}
-    unordered_map<string, unordered_map<string, float> > stdev_low_per_year;    //{year, {month, mean - stdev}}
+    //a flat table with a slot for every month of every year (see month_stats.h), so finding the thresholds of a record is a plain array access
+    //it saves one stdev higher & lower for all year, all month
+    //year and month are the integers decoded by the record parser (ex. "06/05/04" -> year 4, month 6)
+    ThresholdTable thresholds;
 
     //While reading the input file, if the current line is not an anomaly or an empty line, then it will be saved to this vector of string
     //because using random access, it is a lot faster to directly access a vector that stores the text line then re-reading the whole file from the beginning again 
@@ -49,6 +161,9 @@ int main(){
     * vector of string works even for the biggest 2.6GB file given to the class.
     */
     vector<string> text_input;
+    //the temperature of every line of text_input (tenths of a degree), so the hour check can search an hour's temperatures with SIMD
+    //without parsing its lines again (see first_exceedance.h)
+    vector<int16_t> text_temps;
 
     /*
      *************************************************************************************
@@ -63,60 +178,239 @@ int main(){
     //get the start time of this program to determine the total runtime at the end
     auto beg = std::chrono::high_resolution_clock::now();
 
+    //streaming mode writes each month as soon as it's done, so the output file is opened up front
+    ofstream stream_file;
+    if (streaming){
+        stream_file.open("output_serial.txt");
+    }
+    //streaming mode: the records of the current month, 8 bytes each instead of a whole string per line
+    vector<Record> month_records;
+    //streaming mode: months that ended but can't be checked yet because their thresholds are still being worked out, oldest first
+    struct PendingMonth{
+        int year, month;
+        vector<Record> records;
+        vector<HourSummary> hours;
+        vector<int16_t> temps;      //the month's temperatures for the hour check (the finalizer works on a copy)
+    };
+    deque<PendingMonth> pending_months;
+    //min, max & count of every hour of the kept records, built as they're read (see hour_summary.h)
+    //indices are into text_input, or into month_records in streaming mode (a month's hours go with its records)
+    HourSummaryBuilder hour_builder;
+    //the hour check carries over from one month to the next in both modes
+    //-1 so that the very first record always starts a new hour
+    int prev_hour = -1;
+    //flag that determines when to skip to next hour. 1 = skip until next hour is found, 0 = do not skip and keep going
+    //Will use to skip through hours if heating or cooling has been found within that hour
+    bool skip_flag = false;
+
+    //degree-hours past the thresholds of the days in the date range (--waste, see energy_waste.h), added up in the hour check loops
+    WasteTable waste;
+    auto add_waste = [&](const HourSummary& hour, const auto& seasons, const int16_t* temps){
+        Record day = {hour.month, hour.day, hour.year, 0, 0, 0, 0};
+        if (dates.contains(day))
+            waste.add(hour, seasons.month_class(hour.month), hour_waste(hour, thresholds, seasons, temps));
+    };
+
+    //streaming mode: check the month that just ended and write its over-heating & over-cooling hours right away
+    //an hour at a time from its summary, lines are regenerated from the records, and only for the flagged ones
+    auto flush_month = [&](PendingMonth& month){
+        with_seasons(season_policy, [&](const auto& seasons){
+            char line_buf[32];
+            for (size_t h = 0; h < month.hours.size(); h++){
+                const HourSummary& hour = month.hours[h];
+                if (sweep.enabled())
+                    sweep.add_hour(hour, thresholds, seasons);
+                if (waste_enabled)
+                    add_waste(hour, seasons, month.temps.data());
+                long flagged = check_hour(hour, thresholds, seasons, prev_hour, skip_flag, month.temps.data());
+                if (flagged >= 0 && dates.contains(month.records[hour.start_idx + flagged])){
+                    const Record& rec = month.records[hour.start_idx + flagged];
+                    stream_file << flagged_line(format_record(rec, line_buf), hour, thresholds, seasons) << "\n";
+                }
+            }
+        });
+    };
+
+    //months end while the log is still being read: their mean & stdev are worked out in the background (see month_finalizer.h)
+    //and the reading goes on with the next month in the meantime
+    MonthFinalizer finalizer(thresholds, season_policy);
+
+    //streaming mode: check & write the pending months whose thresholds are published, in log order (the hour check runs across months)
+    //with wait, wait for each of them instead of stopping at the first one that isn't ready
+    auto flush_ready_months = [&](bool wait){
+        while (!pending_months.empty()){
+            PendingMonth& month = pending_months.front();
+            if (wait)
+                finalizer.wait(month.year, month.month);
+            else if (!finalizer.published(month.year, month.month))
+                break;
+            flush_month(month);
+            pending_months.pop_front();
+        }
+    };
+
+    //a month is complete: hand its temperatures over to the finalizer (which leaves temps empty for the next month)
+    //streaming mode: the month itself waits in pending_months for its thresholds, with its records, hours & temperatures moved in
+    //and the finalizer gets a copy of the temperatures that it frees as soon as the thresholds are out
+    auto end_month = [&](int year, int month, vector<int16_t>& temps){
+        if (!streaming){
+            finalizer.submit(year, month, temps);
+            return;
+        }
+        vector<int16_t> finalizer_temps(temps);
+        finalizer.submit(year, month, finalizer_temps);
+        PendingMonth pending = {year, month, vector<Record>(), vector<HourSummary>(), vector<int16_t>()};
+        pending.records.swap(month_records);
+        pending.hours.swap(hour_builder.hours());
+        pending.temps.swap(temps);
+        pending_months.push_back(std::move(pending));
+    };
+    //streaming mode: how often (in records) the reading loop looks for a pending month whose thresholds came out in the meantime
+    //so a month is checked & freed a few thousand records after it ends, not only when the next one ends
+    const unsigned long PUBLISH_POLL_RECORDS = 4096;
+
+    //incremental mode: what the last run left off with, and what this run leaves for the next one
+    const string checkpoint_filename = "serial_p1.checkpoint";
+    Checkpoint checkpoint;
+    bool resumed = false;
+    //index in text_input where the last month starts (batch mode), for the next checkpoint
+    unsigned long last_month_start = 0;
+    if (incremental){
+        MappedLog& text = file.text_log();
+        //a line the logger is still writing is left for the next run
+        text.limit(text.complete_size());
+        resumed = checkpoint.load(checkpoint_filename, text, season_policy);
+        if (resumed){
+            text.seek(checkpoint.offset);
+            //finished months never change again, their thresholds come straight from the checkpoint
+            for (size_t i = 0; i < checkpoint.finished.size(); i++){
+                const MonthThreshold& month = checkpoint.finished[i];
+                thresholds.set(month.year, month.month, month.high, month.low, season_policy);
+            }
+            //the hour check picks up where it was at the start of the open month
+            prev_hour = checkpoint.prev_hour;
+            skip_flag = checkpoint.skip_flag;
+        }
+    }
+
+    //date range: thresholds are per month, so the whole months of the range are read (the index says where they start and end,
+    //and what the anomaly filter's prev_temp was there). The hour check starts fresh at the start of the first month
+    //from the cache, its table of months says which records they are, only prev_temp comes from the index
+    LogIndexRange range = LogIndexRange();
+    if (ranged && (file.text_log().is_open() || file.from_cache())){
+        LogIndex index;
+        if (index.open(log_index_filename(log_filename), log_filename, season_policy)){
+            MappedLog& text = file.text_log();
+            uint32_t first_key, last_key;
+            dates.hour_keys(true, first_key, last_key);
+            bool found = index.find(first_key, last_key, range);
+            if (file.from_cache()){
+                uint64_t first = 0, end = 0;
+                if (found && file.cached_log().find_months(dates, first, end))
+                    file.limit_records(first, end);
+                else
+                    file.limit_records(0, 0);
+            }
+            else if (found){
+                text.seek(range.begin);
+                text.limit(range.end);
+            }
+            else{
+                //nothing in the range
+                text.seek(text.size());
+            }
+        }
+        else{
+            cout << "no up to date " << log_index_filename(log_filename) << ", reading the whole log for the date range\n";
+        }
+    }
+
+    //a full read of the text log also writes the index of the log for later date range runs, unless there's an up to date one already
+    LogIndexBuilder index_builder(season_policy);
+    bool build_index = false;
+    if (!ranged && !incremental && file.text_log().is_open()){
+        LogIndex index;
+        build_index = !index.open(log_index_filename(log_filename), log_filename, season_policy);
+    }
+
+    //rolling baseline: its over-heating & over-cooling hours are written as soon as they're found
+    ofstream rolling_file;
+    if (rolling.enabled()){
+        rolling_file.open("output_serial_rolling.txt");
+    }
+
     //if the input text is open, read it through
     if (file.is_open()){
-        //each line of the text file
-        string line;
-        //variable to temporarily store typical temperature of month per year
-        unordered_map<string, float> typical_temp_per_month;   //takes {month, typical temp}
+        //temperatures of the current month, in tenths of a degree (2 bytes each)
+        //when the month ends, the SIMD kernel turns them into count, sum and sum of squares in one go, and mean and stdev come straight
+        //out of those (see month_stats.h)
+        vector<int16_t> month_temps;
 
         //set-up the variables that I'll be using to store previous values
         //prev_temp is for detecting anomalies. If current temperature is 2 degrees away from prev_temp, then ignore it
         float prev_temp = 0;
-        //prev_month is for detecting when the month changes
-        string prev_month = "";
+        //prev_month is for detecting when the month changes (0 means no month has been read yet, months are 1-12)
+        int prev_month = 0;
         //prev_year is for detecting when the year changes
-        string prev_year = "";
-        //temporarily store temperatures of all the days within a specific month and give it to typical_temp_per_month unordered_map in the above
-        vector<float> temp_list;
-        //read each line of the file
-        while(getline(file, line)){
-            //skip blank line
-            if (line == "")
-                continue;
+        int prev_year = 0;
+
+        //incremental mode: put the open month of the last run back as if it had just been read, then carry on after the checkpoint offset
+        if (resumed){
+            char line_buf[32];
+            prev_temp = checkpoint.prev_temp;
+            for (size_t i = 0; i < checkpoint.open_month.size(); i++){
+                const Record& open_rec = checkpoint.open_month[i];
+                prev_month = open_rec.month;
+                prev_year = (i == 0) ? open_rec.year : prev_year;
+                if (streaming){
+                    hour_builder.add(month_records.size(), open_rec);
+                    month_records.push_back(open_rec);
+                }
+                else{
+                    hour_builder.add(text_input.size(), open_rec);
+                    text_input.emplace_back(format_record(open_rec, line_buf));
+                    text_temps.push_back(open_rec.temp);
+                }
+                month_temps.push_back(open_rec.temp);
+            }
+        }
+        //date range: the anomaly filter starts from where it was at the start of the range (0 without an index)
+        if (ranged){
+            prev_temp = range.prev_temp;
+        }
 
-            //using stringstream, I separate the line of string into 3 sections (in array) based on the whitespace
-            //so the line gets separated by 3 sections: date, time, and temperature
-            //Ex. "06/05/04 01:59:38 67.8" -> date, time, temperature
-            stringstream ss(line);
-            string word;
-            //index to indicate where each section of the line should be stored to an array of string named each_line
-            int idx = 0;
-            string each_line[3];
-            while(getline(ss, word, ' ')){  //here, separate string by whitespace, save to string array
-                each_line[idx] = word;
-                idx++;
+        //read each record of the file, already decoded into integers (see record_parser.h)
+        //Ex. "06/05/04 01:59:38 67.8" -> month 6, day 5, year 4, 01:59:38, 678 tenths of a degree
+        //blank lines and lines that don't look like a log record never show up here
+        Record rec;
+        unsigned long records_read = 0;
+        while(file.next_record(rec)){
+            if (build_index){
+                index_builder.add(file.current_offset(), rec);
+            }
+            //streaming mode: check the months whose thresholds came out in the meantime (counting every record, the skipped months' too,
+            //so a month right before a skipped one doesn't wait until the skipped one is over)
+            if (streaming && ++records_read % PUBLISH_POLL_RECORDS == 0 && !pending_months.empty()){
+                flush_ready_months(false);
             }
 
-            //find the current year by reading the date section from the above, use substring to read only the year
-            string curr_year = each_line[0].substr(6, 2);
-            //find month by reading the date section from the above, use substring to read only the month
-            //This curr_month will be used as index when saving typical temperature to typical_temp_per_month map
-            string curr_month = each_line[0].substr(0, 2);
-            //convert to string of temperature that we found from the above into a double, save as current time temperature
-            float curr_temp = stod(each_line[2]);
+            //current year and month
+            int curr_year = rec.year;
+            int curr_month = rec.month;
+            //current time temperature in degrees
+            float curr_temp = record_temp(rec);
 
-            //NOTE assume these months are the months that really don't need any heating and cooling (to save time)
-            if (curr_month == "03" || curr_month == "04" || curr_month == "09"){
+            //NOTE assume the skipped months (March, April, September by default) are the months that really don't need any heating and cooling (to save time)
+            if (season_policy.skipped(curr_month)){
                 //set prev temp to 0 until heating & cooling months start
                 prev_temp = 0;
                 //just keep skipping lines until we meet heating & cooling months
                 continue;
             }
 
-            //check for any anomalies by checking more than 2 degrees away from prev_temp. If it does, skip
+            //check for any anomalies by checking more than 2 degrees (the policy's anomaly delta) away from prev_temp. If it does, skip
             //I placed prev_temp = curr_temp after this if statement so that prev_temp stays the same when anomaly happens
-            if (prev_temp + 2 < curr_temp || prev_temp - 2 > curr_temp){
+            if (prev_temp + season_policy.anomaly_delta < curr_temp || prev_temp - season_policy.anomaly_delta > curr_temp){
                 //if prev_temp is not 0, that means the current month is NOT the beginning of the month
                 //since prev_temp only becomes 0 only when while loop start or start of each month after 03, 04, 09 months are passed
                 //we can use prev_temp to determine when to skip & not skip when anomalies exist -> if prev_temp is not 0, then we know that 
@@ -136,45 +430,23 @@ int main(){
             //we now set this because we know that current temperature is valid
             prev_temp = curr_temp;
 
-            //after skipping anomalies & blank line, save the text input for later use
-            //because now we know that this line is valid & useful
-            text_input.push_back(line);
-
             //if saved date is different, then the month has been changed
             //when you find out that you're in different month, calculate average (typical temp) & standard deviation of prev month
             if (prev_month != curr_month){
                 //check to make sure that prev_month really existed because we're saving the previous month
-                if (prev_month != ""){
-                    /*
-                    * ************************
-                    * Find standard deviation
-                    * ************************
-                    */
-                    //average or typical temperature
-                    typical_temp_per_month[prev_month] = typical_temp_per_month[prev_month] / temp_list.size();
-
-                    //formula to find stdev
-                    float result_val = 0;
-                    int n = temp_list.size();
-                    for (int i = 0; i < n; i++){
-                        //(current temp - average)^2
-                        result_val += pow(temp_list[i] - typical_temp_per_month[prev_month], 2);
-                    }
-                    //divide above result by n, and square root it to find stdev
-                    float stdev = sqrt(result_val / n);
-                    //--------------- End of stdev calculation -----------------
-
+                if (prev_month != 0){
                     //Save one stdev higher & one stdev lower for each year, each month
-                    stdev_high_per_year[prev_year][prev_month] = typical_temp_per_month[prev_month] + stdev;
-                    stdev_low_per_year[prev_year][prev_month] = typical_temp_per_month[prev_month] - stdev;
-
-                    //after calculation, clear temporary variables for future use
-                    temp_list.clear();
-                    typical_temp_per_month.clear();
+                    //from the average (typical temperature) & stdev of the month
+                    //the month is complete, so in streaming mode it can be checked & written as soon as its thresholds are there
+                    end_month(prev_year, prev_month, month_temps);
+                    if (streaming){
+                        flush_ready_months(false);
+                    }
                 }
 
                 //set prev month to be current month
                 prev_month = curr_month;
+                last_month_start = text_input.size();
 
                 //if in different month, then we might be in different year as well
                 //if we're in different year or prev_year is not yet initialized
@@ -183,13 +455,30 @@ int main(){
                 }
             }
 
-            //As long as we don't move to next month, constantly add current temperature to typical_temp_per_month of current month idx
-            //so that we can find the mean later
-            typical_temp_per_month[curr_month] += curr_temp;
-            //save temp_list because we want to know the number of valid elements within that month using this
-            //this will also be used when finding stdev
-            //since we already removed anomalies & new lines, this vector will be used to determine the total # of valid temp. within 1 month
-            temp_list.push_back(curr_temp);
+            //rolling baseline: the record is checked right away against the last N days
+            if (rolling.enabled() && rolling.add(rec, season_policy) && dates.contains(rec)){
+                rolling_file << rolling.flagged_line(file.current_line(), rec, season_policy) << "\n";
+            }
+
+            //after skipping anomalies & blank line, keep the record for the 2nd pass
+            //because now we know that this line is valid & useful
+            if (streaming){
+                hour_builder.add(month_records.size(), rec);
+                month_records.push_back(rec);
+            }
+            else{
+                hour_builder.add(text_input.size(), rec);
+                text_input.emplace_back(file.current_line());
+                text_temps.push_back(rec.temp);
+            }
+
+            //As long as we don't move to next month, keep adding the current temperature to the temperatures of the month
+            month_temps.push_back(rec.temp);
+        }
+        //a log that couldn't be read to the end (ex. a corrupt .gz): no thresholds, output or checkpoint out of part of it
+        if (file.read_failed()){
+            cerr << "Failed to read " << log_filename << ": " << file.read_error() << "\n";
+            return 1;
         }
 
         /*
@@ -198,21 +487,63 @@ int main(){
         * Process isthe same as what I did in the above (calculating average with stdev)
         *************************************************************************
         */
-        //average
-        typical_temp_per_month[prev_month] = typical_temp_per_month[prev_month] / temp_list.size();
-        //find stdev just like what I did above inside the while loop
-        float result_val = 0;
-        int n = temp_list.size();
-        for (int i = 0; i < n; i++){
-            result_val += pow(temp_list[i] - typical_temp_per_month[prev_month], 2);
+        if (prev_month != 0){
+            //streaming mode: every month before the last one has to be checked before the last one
+            if (streaming){
+                flush_ready_months(true);
+            }
+
+            //the last month is the open month of the next checkpoint, save its records
+            //(and in streaming mode the hour check state at its start, which is now since it's checked right below)
+            if (incremental){
+                if (streaming){
+                    checkpoint.open_month = month_records;
+                    checkpoint.prev_hour = prev_hour;
+                    checkpoint.skip_flag = skip_flag;
+                }
+                else{
+                    checkpoint.open_month.resize(text_input.size() - last_month_start);
+                    for (unsigned long i = last_month_start; i < text_input.size(); i++){
+                        parse_record(text_input[i], checkpoint.open_month[i - last_month_start]);
+                    }
+                }
+            }
+
+            //save average + stdev & average - stdev at the same time
+            end_month(prev_year, prev_month, month_temps);
         }
-        float stdev = sqrt(result_val / n);
 
-        //save average + stdev & average - stdev at the same time
-        stdev_high_per_year[prev_year][prev_month] = typical_temp_per_month[prev_month] + stdev;
-        stdev_low_per_year[prev_year][prev_month] = typical_temp_per_month[prev_month] - stdev;
+        //every month's thresholds are in the table from here on
+        finalizer.finish();
+        flush_ready_months(true);
+
+        //the rest of the checkpoint: how far we got, and the anomaly filter state there
+        if (incremental){
+            checkpoint.set_offset(file.text_log(), file.text_log().tell());
+            checkpoint.prev_temp = prev_temp;
+            checkpoint.finished.clear();
+            for (int year = 0; year < ThresholdTable::YEAR_COUNT; year++){
+                for (int month = 1; month <= 12; month++){
+                    //everything except the open month is finished
+                    if (!thresholds.has(year, month) || (year == prev_year && month == prev_month))
+                        continue;
+                    MonthThreshold threshold = {year, month, thresholds.high(year, month), thresholds.low(year, month)};
+                    checkpoint.finished.push_back(threshold);
+                }
+            }
+        }
+
+        //with --async, report how much of the first pass was spent waiting for the disk
+        if (file.reading_async()){
+            auto read_end = std::chrono::high_resolution_clock::now();
+            cout << read_time_report(file, std::chrono::duration<double, std::milli>(read_end - beg).count()) << "\n";
+        }
+
+        //the index of the log, for later date range runs
+        if (build_index && !index_builder.write(log_index_filename(log_filename), file.text_log().size())){
+            cerr << "Failed to write " << log_index_filename(log_filename) << "\n";
+        }
 
-        typical_temp_per_month.clear();
         //close the input file
         file.close();
     }
@@ -225,96 +556,83 @@ int main(){
      * the text line then re-reading the whole file from the beginning again 
      * 
      * and check for over-heating or over-cooling depending on which month we're at
+     * (in streaming mode text_input is empty, every month was already checked when it ended)
      * 
      *************************************************************************************
     */
 
-    string prev_hour = "";
     vector<string> res;
-    //flag that determines when to skip to next hour. 1 = skip until next hour is found, 0 = do not skip and keep going
-    //Will use to skip through hours if heating or cooling has been found within that hour
-    bool skip_flag = false; 
-    for (int i = 0; i < text_input.size(); i++){
-        //using random access, retrieve each line more quickly
-        //I thought this way would be faster than reading the input file again from beginning because this vector has all the valid temperatures
-        string line = text_input[i];
-
-        //split by whitespace using stringstream
-        //now separated into 3 segments: date, time, and temperature
-        //and these are assigned to string array called "each_line"
-        stringstream ss(line);
-        string word;
-        int idx = 0;
-        string each_line[3];
-        while(getline(ss, word, ' ')){  //separate the line into 3 segments using spaces
-            each_line[idx] = word;
-            idx++;
-        }
-
-        //get the current year
-        string curr_year = each_line[0].substr(6, 2);
-        //get the current month
-        string curr_month = each_line[0].substr(0, 2);
-        //get the current hour
-        string curr_hour = each_line[1].substr(0, 2);
-        //get current temperature
-        float curr_temp = stod(each_line[2]);
-
-        //if current hour is different than previous hour, that means an hour has passed
-        //so turn off skip flag because skip flag is used to indicate if we should skip that hour or not
-        //when over-heating or over-cooling hour has been found --> then we want to skip to next hour. That's when this flag is used
-        //so when this flag is on, we skip rest of seconds within that hour until we're at next hour
-        if (prev_hour != curr_hour){
-            skip_flag = false;
-            prev_hour = curr_hour;
-        }
-
-        //skip flag is on which tells the program to skip if heating or cooling time already found within the same hour
-        if (skip_flag == true){
-            continue;
-        }
-
-        //if current month is May to August (cooling months)
-        if (curr_month == "05" || curr_month == "06" || curr_month == "07" || curr_month == "08"){
-            //check for hours when too much cooling going on
-            //go into stdev_low_per_year where we saved average - stdev, find it using current year and current month as indices
-            //if current temperature is lower than that --> over-cooling hour has been found & skip until next hour is found (by setting skip flag on)
-            if (curr_temp < stdev_low_per_year[curr_year][curr_month]){
-                res.push_back(line + " - temp too cold, one stdev lower: " + to_string(stdev_low_per_year[curr_year][curr_month]));
-                skip_flag = true;
+    //an hour at a time: the summary of the hour says whether it's flagged, and only a flagged hour is looked into
+    //to find its first record past the threshold (see hour_summary.h). Compiled for the season policy of this run (see season_policy.h)
+    vector<HourSummary>& hours = hour_builder.hours();
+    with_seasons(season_policy, [&](const auto& seasons){
+        for (size_t h = 0; h < hours.size(); h++){
+            const HourSummary& hour = hours[h];
+
+            //incremental mode: the hour check state at the start of the last month goes into the checkpoint
+            if (incremental && hour.start_idx == last_month_start){
+                checkpoint.prev_hour = prev_hour;
+                checkpoint.skip_flag = skip_flag;
             }
-        }
-        //if current month is October to February (heating months)
-        else if (curr_month == "10" || curr_month == "11" || curr_month == "12" || curr_month == "01" || curr_month == "02"){
-            //check for hours when too much heating going on
-            //go into stdev_high_per_year where we saved average + stdev, find it using current year and current month as indices
-            //if current temperature is higher than that --> over-heating hour has been found & skip until next hour is found (by setting skip flag on)
-
-            if (curr_temp > stdev_high_per_year[curr_year][curr_month]){
-                res.push_back(line + " - temp too warm, one stdev higher: " + to_string(stdev_high_per_year[curr_year][curr_month]));
-                skip_flag = true;
+
+            if (sweep.enabled())
+                sweep.add_hour(hour, thresholds, seasons);
+            if (waste_enabled)
+                add_waste(hour, seasons, text_temps.data());
+            long flagged = check_hour(hour, thresholds, seasons, prev_hour, skip_flag, text_temps.data());
+            if (flagged < 0)
+                continue;
+            //using random access, retrieve the flagged line
+            const string& line = text_input[hour.start_idx + flagged];
+            Record rec;
+            parse_record(line, rec);
+            if (dates.contains(rec)){
+                res.push_back(flagged_line(line, hour, thresholds, seasons));
             }
         }
-    }
+    });
 
     //measure the time by collecting the end time of the program
     auto end = std::chrono::high_resolution_clock::now();
     //find elapsed time by end - start in milliseconds (ms)
     auto elapsed_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - beg).count();
 
-    //create output file that I'll be writing all the over-heating and over-cooling time
-    string st;
-    ofstream output_file("output_serial.txt");
-    if (output_file.is_open()){
-        //since we've saved all the over-heating & over-cooling hours in res, read the res vector and write to output file
-        for (int i = 0; i < res.size(); i++){
-            output_file << res[i] << "\n";
+    //streaming mode already wrote every month, only the elapsed time is left
+    if (streaming){
+        if (stream_file.is_open()){
+            stream_file << "elapsed time for serial version (streaming): " << elapsed_time << " ms\n";
+            stream_file.close();
+        }
+    }
+    else{
+        //create output file that I'll be writing all the over-heating and over-cooling time
+        ofstream output_file("output_serial.txt");
+        if (output_file.is_open()){
+            //since we've saved all the over-heating & over-cooling hours in res, read the res vector and write to output file
+            for (int i = 0; i < res.size(); i++){
+                output_file << res[i] << "\n";
+            }
+            //write the elapsed time to the output file as well
+            output_file << "elapsed time for serial version: " << elapsed_time << " ms\n";
+            //close the output file
+            output_file.close();
         }
-        //write the elapsed time to the output file as well
-        output_file << "elapsed time for serial version: " << elapsed_time << " ms\n";
-        //close the output file
-        output_file.close();
+    }
+
+    //the sweep table of every month that was checked
+    if (sweep.enabled() && !sweep.write("output_serial_sweep.txt")){
+        cerr << "Failed to write output_serial_sweep.txt\n";
+    }
+
+    //the degree-hours of every day
+    if (waste_enabled && !waste.write("output_serial_waste.txt")){
+        cerr << "Failed to write output_serial_waste.txt\n";
+    }
+
+    //incremental mode: only once the output is written, save where this run stopped for the next one
+    if (incremental && !checkpoint.save(checkpoint_filename, season_policy)){
+        cerr << "Failed to write " << checkpoint_filename << "\n";
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -1,11 +1,14 @@
 #include <iostream>
 #include <fstream>
 #include <string>
-#include <sstream>
 #include <vector>
 #include <unordered_map>
 #include <chrono>
 #include <cmath>
+#include <algorithm>
+#include "record_parser.h"
+#include "log_input.h"
+#include "log_index.h"
 
 using namespace std;
 
@@ -107,74 +110,109 @@ void sort_by_similarity(){
     sort(result_similarity_date.begin(), result_similarity_date.end(), CompareSimilarity);
 }
 
-int main(){
+/*
+ * Usage: ./serial_p2 [--async] [--from MM/DD/YY] [--to MM/DD/YY]
+ *      --async: read the text log on a separate I/O thread (see async_reader.h) and print how the first step's time splits into I/O stalls and parsing
+ *      --from, --to: only look at these days (both included, either one can be left out). The days at the edges are only compared with
+ *                    the days inside the range. From the cache (its table of days, see log_cache.h) or with an up to date "<input file>.index"
+ *                    (see log_index.h) only those days are read, otherwise the whole log is read and the other days are skipped
+*/
+int main(int argc, char* argv[]){
+    bool async_read = false;
+    string from_arg, to_arg;
+    for (int i = 1; i < argc; i++){
+        string arg = argv[i];
+        if (arg == "--async")
+            async_read = true;
+        else if (arg == "--from" && i + 1 < argc)
+            from_arg = argv[++i];
+        else if (arg == "--to" && i + 1 < argc)
+            to_arg = argv[++i];
+    }
+
+    //date range of the days we look at (see log_index.h), without --from / --to everything is in range
+    bool ranged = !from_arg.empty() || !to_arg.empty();
+    DateRange dates;
+    if (!dates.set(from_arg, to_arg)){
+        cerr << "--from and --to need a date like 01/31/11 (MM/DD/YY)\n";
+        return 1;
+    }
     
-    ifstream file(input_filename);
+    //read the binary cache of the input file if there's an up to date one, otherwise the memory-mapped text (see log_input.h)
+    LogInput file(input_filename, async_read && !ranged);
     auto start = std::chrono::high_resolution_clock::now();
 
+    //date range from the cache: its table of days says which records they are
+    if (ranged && file.from_cache()){
+        uint64_t first = 0, end = 0;
+        file.cached_log().find_days(dates, first, end);
+        file.limit_records(first, end);
+    }
+
+    //date range: jump straight to the first day of the range and stop after the last one
+    if (ranged && file.text_log().is_open()){
+        LogIndex index;
+        LogIndexRange range;
+        uint32_t first_key, last_key;
+        dates.hour_keys(false, first_key, last_key);
+        if (!index.open(log_index_filename(input_filename), input_filename, season_policy)){
+            cout << "no up to date " << log_index_filename(input_filename) << ", reading the whole log for the date range\n";
+        }
+        else if (index.find(first_key, last_key, range)){
+            file.text_log().seek(range.begin);
+            file.text_log().limit(range.end);
+        }
+        else{
+            //nothing in the range
+            file.text_log().seek(file.text_log().size());
+        }
+    }
+
+    //a full read of the text log also writes the index of the log for later date range runs, unless there's an up to date one already
+    LogIndexBuilder index_builder(season_policy);
+    bool build_index = false;
+    if (!ranged && file.text_log().is_open()){
+        LogIndex index;
+        build_index = !index.open(log_index_filename(input_filename), input_filename, season_policy);
+    }
+
     /**
      * 
      * 1st step: Open the input text file and keep a track of the occurence of temperatures for each day
      * 
     */
     if (file.is_open()){
-        //each line of the text file
-        string line;
+        //feature vector of the day we're currently reading, and the date of the last record that was read
+        //the day only changes once every few thousand lines, so the map lookup with the string keys is only done when it does
+        unordered_map<int, int>* curr_day_temp = NULL;
+        Record prev_rec = Record();
 
-        //read each line of the file
-        while(getline(file, line)){
-            //skip blank line
-            if (line == "")
+        /**
+         * 
+         * Read each record of the file, already decoded into integers (see record_parser.h). Blank and malformed lines are skipped by the reader
+         * Ex. 06/05/04 01:59:37 68.1 -> month 6, day 5, year 4, temperature 681 (tenths of a degree)
+         * Round the temperature to an int (to make everyone's life easier)
+         * 
+        */
+        Record rec;
+        while(file.next_record(rec)){
+            if (build_index){
+                index_builder.add(file.current_offset(), rec);
+            }
+            //without an index, days outside of the date range are read but skipped
+            if (ranged && !dates.contains(rec)){
                 continue;
-
-            /*
-             *  
-             * Using stringstream, I separate the string by their white spaces -> split them into 3 segments
-             * then I store each segment into each_line array
-             * Ex. 06/05/04 01:59:37 68.1 -> each_line[0] = 06/05/04, each_line[1] = 01:59:37, each_line[2] = 68.1
-             * 
-            */
-            stringstream ss(line);
-            string word;
-            int idx = 0;
-            string each_line[3];
-            while(getline(ss, word, ' ')){
-                each_line[idx] = word;
-                idx++;
             }
-            
-            /**
-             * 
-             * By reading the substring of each index of the array, I can get current year, current month, current day, and current temperature
-             * Since each_line[0] is like 06/05/04 -> can get year, month, day
-             * Since each_line[2] only contains temperature as string -> convert to decimal & round it to an int (to make everyone's life easier)
-             * 
-            */
-            string curr_year = each_line[0].substr(6, 2);
-            string curr_month = each_line[0].substr(0, 2);
-            string curr_day = each_line[0].substr(3, 2);
-            int curr_temp = round(stod(each_line[2]));
-
-            /**
-             * 
-             * use global variable log_info_map to insert data
-             * One thing that I like about map is that if it doesn't contain the key that you're looking for, it creates one for you (only when you
-             * try to access them using brackets [])
-             * Therefore, if current year, current month, current day, and current temperature doesn't exist in map -> it creates one for you, set it to value 0
-             * But since we're currently at current temperature -> add 1 to it (because we want feature vector that stores the occurrence of temperature
-             * within that day)
-             * In this way, I can keep adding 1s to the corresponding temperature whenever I read the input text file
-             * 
-            */
-            log_info_map[curr_year][curr_month][curr_day][curr_temp] += 1;
 
+            int curr_temp = round(rec.temp / 10.0);
 
             /**
              * 
              * Now, one problem that we're having here is that we do not know which year,month,or day we have visited so far!
              * So, we need a list that stores all the date that we have found
              * 
-             * First, make DateInfo with current year, current month, and current day because that's what date_list is made up of.
+             * Whenever the date is different from the previous record (or it's the first record), make DateInfo with current year, current month, and current day 
+             * because that's what date_list is made up of.
              * Then, using if statement, first check if date_list is empty -> if it is, we insert the current DateInfo instance
              *      - Have to do this because if date_list is empty but we try to access it using [] -> error occurs
              * If date_list is not empty -> then check if the latest DateInfo element of the list is the same as our current DateInfo instance
@@ -183,18 +221,54 @@ int main(){
              *      - Notice that I didn't increment date_list_idx from date_list.empty() if statement. It is because date_list_idx starts from 0
              *          - so when an element is added for the first time to list -> it will be stored at list[0] -> so no need to increment date_list_idx
              * 
+             * Also look up the feature vector of the day in log_info_map here
+             * One thing that I like about map is that if it doesn't contain the key that you're looking for, it creates one for you (only when you
+             * try to access them using brackets [])
+             * The pointer stays valid even when log_info_map grows, because unordered_map never moves its elements
+             * 
             */
-            DateInfo di = DateInfo(curr_year, curr_month, curr_day);
-
-            if (date_list.empty()){
-                date_list.push_back(di);
-            }
-            else if (!(date_list[date_list_idx] == di)){
-                date_list.push_back(di);
-                date_list_idx += 1;
+            if (curr_day_temp == NULL || rec.day != prev_rec.day || rec.month != prev_rec.month || rec.year != prev_rec.year){
+                DateInfo di = DateInfo(two_digits(rec.year), two_digits(rec.month), two_digits(rec.day));
+
+                if (date_list.empty()){
+                    date_list.push_back(di);
+                }
+                else if (!(date_list[date_list_idx] == di)){
+                    date_list.push_back(di);
+                    date_list_idx += 1;
+                }
+
+                curr_day_temp = &log_info_map[di.year][di.month][di.day];
+                prev_rec = rec;
             }
+
+            /**
+             * 
+             * Insert the data to the feature vector of the current day
+             * If current temperature doesn't exist in the feature vector -> it creates one for you, set it to value 0
+             * But since we're currently at current temperature -> add 1 to it (because we want feature vector that stores the occurrence of temperature
+             * within that day)
+             * In this way, I can keep adding 1s to the corresponding temperature whenever I read the input text file
+             * 
+            */
+            (*curr_day_temp)[curr_temp] += 1;
+        }
+        //the similarities of part of the log would look just like real ones
+        if (file.read_failed()){
+            cerr << "Failed to read " << input_filename << ": " << file.read_error() << "\n";
+            return 1;
         }
 
+        //with --async, report how much of the reading was spent waiting for the disk
+        if (file.reading_async()){
+            auto read_end = std::chrono::high_resolution_clock::now();
+            cout << read_time_report(file, std::chrono::duration<double, std::milli>(read_end - start).count()) << "\n";
+        }
+
+        //the index of the log, for later date range runs
+        if (build_index && !index_builder.write(log_index_filename(input_filename), file.text_log().size())){
+            cerr << "Failed to write " << log_index_filename(input_filename) << "\n";
+        }
         file.close();
     }
 
@@ -0,0 +1,135 @@
+#ifndef SIGMA_SWEEP_H
+#define SIGMA_SWEEP_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include "month_stats.h"
+#include "season_policy.h"
+#include "hour_summary.h"
+#include "first_exceedance.h"
+
+/*
+ * ******************************************************
+ *
+ * Sigma sweep: over-heating & over-cooling hour counts for several thresholds at once
+ *
+ * The normal check flags hours past mean +- sigma * stdev. To see how the counts change with the threshold (ex. 0.5, 1, 1.5 and 2 stdevs)
+ * the program used to be edited and run once per level. The sweep counts every level in the same 2nd pass instead.
+ * It works on the per-hour summaries (see hour_summary.h): whether an hour is flagged at a level only depends on its min (max) against
+ * that level's threshold, so it's one compare per level per hour, no matter how many records the hour has. Every level keeps its own
+ * prev_hour / skip_flag, so a level's count is exactly what the normal check would flag with that level as its sigma.
+ *
+ * Output: one row per month that was checked, with its class, the number of hours and the flagged hours of every level, ex.
+ *      month   class    hours     0.5       1     1.5       2
+ *      01/04   heating    744     212      98      31       6
+ * Months are counted whole (a date range only cuts down the normal output).
+ *
+ * ******************************************************
+*/
+class SigmaSweep{
+public:
+    //levels from a comma separated list like "0.5,1,1.5,2", returns false if it can't be read
+    bool set_levels(const std::string& list){
+        sweep_levels.clear();
+        size_t pos = 0;
+        while (pos <= list.size()){
+            size_t comma = list.find(',', pos);
+            if (comma == std::string::npos)
+                comma = list.size();
+            std::string item = list.substr(pos, comma - pos);
+            char* end = NULL;
+            float k = strtof(item.c_str(), &end);
+            if (item.empty() || *end != '\0' || !(k >= 0))
+                return false;
+            sweep_levels.push_back(k);
+            pos = comma + 1;
+        }
+        prev_hour.assign(sweep_levels.size(), -1);
+        skip_flag.assign(sweep_levels.size(), false);
+        low_bounds.resize(sweep_levels.size());
+        high_bounds.resize(sweep_levels.size());
+        return !sweep_levels.empty();
+    };
+
+    bool enabled() const{
+        return !sweep_levels.empty();
+    };
+
+    //count the next hour (hours have to come in log order, like for check_hour)
+    template <typename Policy>
+    void add_hour(const HourSummary& hour, const ThresholdTable& thresholds, const Policy& seasons){
+        MonthClass month_class = seasons.month_class(hour.month);
+        if (rows.empty() || rows.back().year != hour.year || rows.back().month != hour.month){
+            start_month(hour.year, hour.month, month_class, thresholds);
+        }
+        MonthRow& row = rows.back();
+        row.hours++;
+        for (size_t l = 0; l < sweep_levels.size(); l++){
+            if (prev_hour[l] != hour.hour){
+                skip_flag[l] = false;
+                prev_hour[l] = hour.hour;
+            }
+            if (skip_flag[l])
+                continue;
+            bool flagged = (month_class == MONTH_COOLING && hour.min_temp < low_bounds[l]) ||
+                           (month_class == MONTH_HEATING && hour.max_temp > high_bounds[l]);
+            if (flagged){
+                skip_flag[l] = true;
+                row.flagged[l]++;
+            }
+        }
+    };
+
+    //write the table, returns false if the file couldn't be written
+    bool write(const std::string& filename) const{
+        FILE* out = fopen(filename.c_str(), "w");
+        if (out == NULL)
+            return false;
+        fprintf(out, "month   class    hours");
+        for (size_t l = 0; l < sweep_levels.size(); l++){
+            fprintf(out, " %7g", sweep_levels[l]);
+        }
+        fprintf(out, "\n");
+        for (size_t r = 0; r < rows.size(); r++){
+            const MonthRow& row = rows[r];
+            const char* class_name = (row.month_class == MONTH_COOLING) ? "cooling" : (row.month_class == MONTH_HEATING) ? "heating" : "neutral";
+            fprintf(out, "%02d/%02d   %-7s %6u", row.month, row.year, class_name, row.hours);
+            for (size_t l = 0; l < sweep_levels.size(); l++){
+                fprintf(out, " %7u", row.flagged[l]);
+            }
+            fprintf(out, "\n");
+        }
+        return fclose(out) == 0;
+    };
+
+private:
+    struct MonthRow{
+        int year, month;
+        MonthClass month_class;
+        uint32_t hours;
+        std::vector<uint32_t> flagged;      //per level
+    };
+
+    //a new month: its row, and the int16 bounds of every level (see first_exceedance.h)
+    void start_month(int year, int month, MonthClass month_class, const ThresholdTable& thresholds){
+        MonthRow row = {year, month, month_class, 0, std::vector<uint32_t>(sweep_levels.size(), 0)};
+        rows.push_back(row);
+        for (size_t l = 0; l < sweep_levels.size(); l++){
+            float high, low;
+            thresholds.level(year, month, sweep_levels[l], high, low);
+            threshold_bounds(low, high, low_bounds[l], high_bounds[l]);
+        }
+    };
+
+    std::vector<float> sweep_levels;
+    std::vector<MonthRow> rows;
+    //per level: the hour check state, and the bounds of the current month
+    std::vector<int> prev_hour;
+    std::vector<char> skip_flag;
+    std::vector<int16_t> low_bounds, high_bounds;
+};
+
+#endif
@@ -2,16 +2,16 @@
 #include <pthread.h>
 #include <fstream>
 #include <string>
-#include <sstream>
 #include <vector>
-#include <unordered_map>
 #include <chrono>
-#include <cmath>
-#include <queue>
-
-//declare the number threads that we're going to use from here
-//used define so that whenever we make changes to it, simply change this number
-#define THREAD_NUM 5
+#include "record_parser.h"
+#include "log_input.h"
+#include "record_store.h"
+#include "parallel_first_pass.h"
+#include "season_policy.h"
+#include "hour_summary.h"
+#include "work_stealing_pool.h"
+#include "async_writer.h"
 
 using namespace std;
 
@@ -20,24 +20,28 @@ using namespace std;
  * 
  * Task Parallelism
  * 
- * During the input file read, it creates Month Task that lets the thread know when each month starts and ends in a form of a task & put into Month Task queue that will be used for 1st stage!! 
+ * During the input file read, it creates Month Task that lets the thread know when each month starts and ends in a form of a task & submits it to the thread pool that will be used for 1st stage!! 
  * (because threads need tasks to begin with)
  * 
  * It is 3 stage pipeline where:
  * 1st stage reads data by each month (Month task created during reading the input text file) -> segments each month by each hour and pass it to 2nd stage as a DateTask
  * 2nd stage reads each hour -> find out whether it's over-heating or over-cooling and pass this information to 3rd stage as another OutputTask
- * 3rd stage reads the OutputTask and Write to output file. Since it's 3 stage pipeline, no task gets created from 3rd stage.
+ * 3rd stage reads the OutputTask and hands it to the writer thread of the output file. Since it's 3 stage pipeline, no task gets created from 3rd stage.
+ * All three stages run on one work-stealing pool (see work_stealing_pool.h): a task spawns the tasks of the next stage onto the deque
+ * of the thread that runs it, that thread takes the newest one first (so a flagged hour is written right after it was checked),
+ * and idle threads steal the oldest ones (ex. the rest of the hours of a month).
  * 
  * [Below info are already mentioned in serial & data parallel]
  * Note before getting started:
  * I have decided cooling months as: May, June, July, August
  * I have decided heating months as: October, November, December, January, February
  * March, April, and September are not considered and therefore, ignored
+ * (that's the default season policy, --seasons changes it, see season_policy.h)
  * 
  * Note on how I decided to find over-heating and over-cooling:
  * I first read the whole month, find typical temperature (average) of that month and its standard deviation, and save them in map.
- * Also, save all the valid lines (ignore newlines and anomalies) of input file in a vector of string.
- * Then in the 2nd run with vector of string, I use this average with stdev to determine over-cooling & over-heating status of each hour by comparing each temperature
+ * Also, save all the valid records (ignore newlines and anomalies) of input file in a record store.
+ * Then in the 2nd run with the record store, I use this average with stdev to determine over-cooling & over-heating status of each hour by comparing each temperature
  * with what's in the map depending on what month we're currently in (only for either cooling or heating month)
  * 
  * ****************************************************** 
@@ -45,10 +49,14 @@ using namespace std;
 
 /*
  * Task called "MonthTask" that will be used in 1st stage
- * Saves start index & end index of each month within the vector of string called "text_input"
+ * Saves start index & end index of each month within the record store called "text_input"
 */
 typedef struct MonthTask{
     unsigned long start_idx, end_idx;
+    //summary of every hour of the month, built by the first pass (see hour_summary.h)
+    const vector<HourSummary>* hours = NULL;
+    //season policy the month's thresholds were set with, its hours are checked with the same one
+    const SeasonPolicy* policy = NULL;
     //struct constructor
     MonthTask(){};
     MonthTask(unsigned long start_idx, unsigned long end_idx){
@@ -59,14 +67,17 @@ typedef struct MonthTask{
 
 /*
  * Task called "DateTask" that will be used in 2nd stage
- * Saves the start index and end index of each hour of each month within the vector of string called "text_input"
+ * Saves the summary of one hour of a month: where it starts within the record store called "text_input", how many records it has
+ * and its min & max temperature (see hour_summary.h)
 */
 typedef struct DateTask{
-    unsigned long hour_start_idx, hour_end_idx;
+    HourSummary hour;
+    //the policy of its month task
+    const SeasonPolicy* policy = NULL;
     DateTask(){};
-    DateTask(unsigned long hour_start_idx, unsigned long hour_end_idx){
-        this->hour_start_idx = hour_start_idx;
-        this->hour_end_idx = hour_end_idx;
+    DateTask(const HourSummary& hour, const SeasonPolicy* policy){
+        this->hour = hour;
+        this->policy = policy;
     }
 }DateTask;
 
@@ -82,482 +93,205 @@ typedef struct OutputTask{
     };
 }OutputTask;
 
-//IMPORTANT: I've set all of these variables as global because the threads need to use them as well from a separate method call
-//task queue has task where each task = start and end date of each month
-//So 256 can cover nearly all months in 21 years, which is more than enough
-MonthTask month_task_queue[256];
-int month_task_count = 0;     //task_count to move through the task queue above
+/*
+ * What the thread pool runs: a task of one of the 3 stages (only the one of its stage is filled in)
+*/
+enum TaskStage{
+    STAGE_MONTH,
+    STAGE_DATE,
+    STAGE_OUTPUT
+};
 
-//since there are 60 mins x 60 sec = 3600 possible input command within 1 hour period, use queue library instead of using array as queue
-//since using the array slike a queue is only efficient when it's size is less than 500, I decided to use queue library
-queue<DateTask> date_task_queue;
+typedef struct PoolTask{
+    TaskStage stage;
+    MonthTask month_task;
+    DateTask date_task;
+    OutputTask output_task;
+}PoolTask;
 
-//since there are 24 hours in 1 day, and 30 days in 1 month, it will need at max 24 x 30 = 720 spaces in worst case
-//so use queue instead of using array as queue
-queue<OutputTask> output_task_queue;
+typedef WorkStealingPool<PoolTask> TaskPool;
 
-//Since anything that is being shared is considered a critical section, need mutex locks for all of them
-//because we do not want to lose data from multiple threads working on the same file or queue at the same time and making changes to them
-pthread_mutex_t mutex_month_task_queue;       //lock for rearranging month task queue
-pthread_mutex_t mutex_date_queue;           //lock for rearranging date task queue
-pthread_mutex_t mutex_output_queue;         //lock for rearranging output task queue
-pthread_mutex_t mutex_file;                 //mutex lock for writing to a file
+//IMPORTANT: I've set all of these variables as global because the threads need to use them as well from a separate method call
+//(the tasks themselves are in the pool made in main, every queue & its lock is part of it)
+
+//the output file is owned by one writer thread (see async_writer.h) instead of being opened & appended to under a lock for every line
+AsyncWriter output_writer;
 
-//store each lines of the text
+//store each valid record of the text
 /*
- * since the maximum size of the vector of string is at least 2^42 – 1 (2^(64 – size(string))-1 where size of string = 22 per line in input file) 
- * in 64bit OS, I knew for sure that it wouldn’t throw the overflow during the operation. I have already confirmed that storing input text file as 
- * vector of string works even for the biggest 2.6GB file given to the class.
+ * 6 bytes per record (packed date & time + temperature, see record_store.h) instead of a whole string per line,
+ * tasks address the records by index just like they did with the vector of string.
+ * The text of a record is only regenerated for the over-heating & over-cooling hours that get written to the output file.
 */
-vector<string> text_input;
+RecordStore text_input;
 
 //save average + 1 stdev(high) & stdev - 1 stdev(low) for all months of all years
-unordered_map<string, unordered_map<string, float> > stdev_high_per_year;   //{year, {month, mean + stdev}}
-unordered_map<string, unordered_map<string, float> > stdev_low_per_year;    //{year, {month, mean - stdev}}
+//flat table indexed by year & month (see month_stats.h), a month's slot is filled in by the first pass before its task is submitted and only read after
+ThresholdTable month_thresholds;
 
 //use pointer(*task) bc we dont want to create a copy of it
 //this is the function that each thread calls to execute the each of the month tasks
-void execute_task(MonthTask* task){
-
-    //save the prev hour to determine when the hour changes to the next one
-    //bc i need to know whenever the hour changes so that I can pass it on to the next stage
-    string prev_hour = "";
-
-    //you have to set start idx and end idx to task->start_idx because thats where the hour idx is located
-    //these variables will be used to determine when each hour starts & end --> and will be passed over to 2nd stage
-    unsigned long hour_start_idx = task->start_idx, hour_end_idx = task->start_idx;
-
-    //using each month's start idx & end idx -> we can read data chunks independently that are saved in vector of string called "text_input"
-    for (int i = task->start_idx; i <= task->end_idx; i++){
-        //using random access, retrieve each line more quickly
-        string line = text_input[i];
-
-        //split by space using stringstream
-        //using stringstream, I separate the line of string into 3 sections (in array) based on the whitespace
-        //so the line gets separated by 3 sections: date, time, and temperature
-        //Ex. "06/05/04 01:59:38 67.8" -> date, time, temperature
-        stringstream ss(line);
-        string word;
-        int idx = 0;
-        string each_line[3];
-        while(getline(ss, word, ' ')){  //separate the line into 3 segments using spaces
-            each_line[idx] = word;
-            idx++;
-        }
-
-        //find the hour
-        string curr_hour = each_line[1].substr(0, 2);
-
-        //if the hour has changed
-        if (prev_hour != curr_hour){
-            //if prev_hour is not empty (since when this for-loop first runs, prev_hour is "" so we have to make sure that prev_hour has a value)
-            if (prev_hour != ""){
-                //lock it because we're updating this queue
-                //Since these hour indices are also getting shared by multiple threads --> it should be treated as critical section (so put in the lock)
-                pthread_mutex_lock(&mutex_date_queue);
-                hour_end_idx = i - 1;   //update end index
-                date_task_queue.push(DateTask(hour_start_idx, hour_end_idx));   //push new date task to a queue
-                hour_start_idx = i;     //update start index
-                pthread_mutex_unlock(&mutex_date_queue);    //unlock mutex so other threads can update the DateTask queue now
-            }
-            //set prev hour to current hour and continue
-            prev_hour = curr_hour;
-        }
+void execute_task(MonthTask* task, TaskPool& pool, int worker){
+    //the first pass already split the month into hours (see hour_summary.h), so every hour just becomes a date task
+    //on this thread's own deque, other threads steal them from there
+    PoolTask date_task;
+    date_task.stage = STAGE_DATE;
+    for (size_t h = 0; h < task->hours->size(); h++){
+        date_task.date_task = DateTask((*task->hours)[h], task->policy);
+        pool.spawn(worker, date_task);
     }
 }
 
 //For each month, read each day's each time(hour), determine if overheating or overcooling is taking place within that hour
-//So, this method reads through all seconds within each hour
-//this is the function that each thread calls to work on each date task
-void execute_date_task(DateTask* date_task){
-    //read all time interval within that specific hour
-    for (int i = date_task->hour_start_idx; i <= date_task->hour_end_idx; i++){
-        //string that has all the information about that specific time period
-        string hour_line = text_input[i];
-
-        //using stringstream, I separate the line of string into 3 sections (in array) based on the whitespace
-        //so the line gets separated by 3 sections: date, time, and temperature
-        //Ex. "06/05/04 01:59:38 67.8" -> date, time, temperature
-        stringstream ss(hour_line);
-        string word;
-        int idx = 0;
-        string each_line[3];
-        while(getline(ss, word, ' ')){  //separate the line into 3 segments using spaces
-            each_line[idx] = word;
-            idx++;
-        }
-
-        //find the year
-        string curr_year = each_line[0].substr(6, 2);
-        //find the month
-        string curr_month = each_line[0].substr(0, 2);
-        //find the hour
-        string curr_hour = each_line[1].substr(0, 2);
-        //current temperature
-        float curr_temp = stod(each_line[2]);
-
-        //if current month is May to August (cooling months)
-        if (curr_month == "05" || curr_month == "06" || curr_month == "07" || curr_month == "08"){
-            //check for hours when too much cooling going on
-            if (curr_temp < stdev_low_per_year[curr_year][curr_month]){
-                //if over-cooling is happening:
-                //assign new task to output task queue. While assigning, need to lock it to prevent other threads to update it at the same time
-                pthread_mutex_lock(&mutex_output_queue);
-                output_task_queue.push(OutputTask(hour_line + " - temp too cold, one stdev lower: " + to_string(stdev_low_per_year[curr_year][curr_month])));
-                pthread_mutex_unlock(&mutex_output_queue);
-                //break out and make thread to end checking the rest of the hour because over-cooling is already found
-                //we can do this because each DateTask covers each hour --> so if we break, then that stops thread from reading rest of the hour
-                break;
-            }
-        }
-        //if current month is October to February (heating months)
-        else if (curr_month == "10" || curr_month == "11" || curr_month == "12" || curr_month == "01" || curr_month == "02"){
-            //check for hours when too much heating going on
-            if (curr_temp > stdev_high_per_year[curr_year][curr_month]){
-                //if over-heating is happening:
-                //assign new task to output task queue. While assigning, need to lock it to prevent other threads to update it at the same time
-                pthread_mutex_lock(&mutex_output_queue);
-                output_task_queue.push(OutputTask(hour_line + " - temp too warm, one stdev higher: " + to_string(stdev_high_per_year[curr_year][curr_month])));
-                pthread_mutex_unlock(&mutex_output_queue);
-                //break out and make thread to end checking the rest of the hour because over-heating is already found
-                break;
-            }
-        }
+//The min & max of the hour say that right away, only a flagged hour is read to find its first record past the threshold
+//written for any season policy (see season_policy.h), execute_date_task picks the one of the task
+template <typename Policy>
+void check_date_task(const DateTask* date_task, const Policy& seasons, TaskPool& pool, int worker){
+    //the thresholds are only read here
+    const ThresholdTable& thresholds = month_thresholds;
+
+    long flagged = find_flagged(date_task->hour, thresholds, seasons, text_input.temp_data());
+    if (flagged >= 0){
+        //if over-cooling or over-heating is happening:
+        //spawn the output task for it (on this thread's deque, so it's the next thing this thread does)
+        PoolTask output_task;
+        output_task.stage = STAGE_OUTPUT;
+        output_task.output_task = OutputTask(flagged_line(text_input.line(date_task->hour.start_idx + flagged), date_task->hour, thresholds, seasons));
+        pool.spawn(worker, output_task);
     }
 }
 
+//this is the function that each thread calls to work on each date task
+void execute_date_task(DateTask* date_task, TaskPool& pool, int worker){
+    with_seasons(*date_task->policy, [&](const auto& seasons){
+        check_date_task(date_task, seasons, pool, worker);
+    });
+}
+
 //this is the function that each thread calls to work on output task where output task is to write to the output file
+//the line goes to the writer thread, which puts it in its buffer and writes the buffer out in big pieces (no lock, no reopening the file)
 void execute_output_task(OutputTask* output_task){
-
-    //using mutex_file lock, only allow 1 thread to write to the output file at the same time
-    pthread_mutex_lock(&mutex_file);
-    //append to an existing file by using ios_base::app
-    ofstream output_file("output_task_parallel.txt", ios_base::app);
-    if (output_file.is_open()){
-        output_file << output_task->output_string << "\n";
-        output_file.close();
-    }
-    //unlock so that now other threads can write to it
-    pthread_mutex_unlock(&mutex_file);
+    output_task->output_string += '\n';
+    output_writer.write(std::move(output_task->output_string));
 }
 
-//function that starts the threads and call to pick up the task from the task queue
-void* start_thread(void* args){
-
-    //thread either waits or execute the task, so it's not gonna terminate
-    //UNLESS all the queues (task queue, date task queue, output task queue are empty)
-    while(1){
-        /**
-         * VERY IMPORTANT!
-         * THIS IF STATEMENT IS TO ASSIGN 3RD STAGE TASKS TO THREADS
-         * since output_task is the last stage (3rd stage), I gave highest priority to it.
-         * therefore, if any works remaining at last stage, it gets handed over to thread first
-        */
-        if (!output_task_queue.empty()){
-
-            //Use the lock to prevent other threads to work on it at the same time because after assigning a task, we have to rearrange the queue
-            pthread_mutex_lock(&mutex_output_queue);
-
-            /*
-             * VERY IMPORTANT!!!! 
-             * Since multiple threads can work on the same output task queue --> there's a chance of 2+ threads passing the above if statement that 
-             * checks if output task queue is empty when output task queue only has 1 (or less than the number of threads working on 3rd stage) output task.
-             * SO, just to be safe, after the thread getting an access to the lock --> it should double check if output task queue is still contains a output task
-             * If you don't do this, segmentation fault occurs because threads will try to access elements from the queue even though it's empty 
-             * 
-             * This is happening because we have mutex lock inside the if statement of (!output_task_queue.empty()), not outside. I intentionally did this
-             * to give priorities to each stage
-            */
-            if (output_task_queue.empty()){
-                //so if queue is empty, unlock the lock and continue to stay within the while loop (put thread in wait state)
-                pthread_mutex_unlock(&mutex_output_queue);
-                continue;
-            }
-
-            //read the first task in output queue, and remove it afterward
-            OutputTask output_task = output_task_queue.front();
-            output_task_queue.pop();
-            
-            //unlock so that other threads can now work on it
-            pthread_mutex_unlock(&mutex_output_queue);
-
-            //execute operation for output_task_queue
-            execute_output_task(&output_task);
-        }
-        /*
-         * THIS IF STATEMENT IS TO ASSIGN 2RD STAGE TASKS TO THREADS
-         * If the above output task queue is empty --> then threads take a look into date task queue
-         * because date task queue has the 2nd highest priority (2nd stage)
-         * therefore, if output task queue is empty but date task queue is not, then threads grab works from output task queue 
-        */
-        else if (!date_task_queue.empty()){
-
-            //Use the lock to prevent other threads to work on it at the same time because after assigning a task, we have to rearrange the queue
-            pthread_mutex_lock(&mutex_date_queue);
-
-            /*
-             * VERY IMPORTANT!!!! 
-             * Since multiple threads can work on the same date task queue --> there's a chance of 2+ threads passing the above if statement that 
-             * checks if date task queue is empty when date task queue only has 1 (or less than the number of threads working on 3rd stage) date task.
-             * SO, just to be safe, after the thread getting an access to the lock --> it should double check if date task queue is still contains a date task
-             * If you don't do this, segmentation fault occurs because threads will try to access elements from the queue even though it's empty 
-             * 
-             * This is happening because we have mutex lock inside the if statement of (!date_task_queue.empty()), not outside. I intentionally did this
-             * to give priorities to each stage
-            */
-            if (date_task_queue.empty()){
-                //so if queue is empty, unlock the lock and continue to stay within the while loop (put thread in wait state)
-                pthread_mutex_unlock(&mutex_date_queue);
-                continue;
-            }
-
-            //read the first element of the date task queue
-            DateTask date_task = date_task_queue.front();
-            //remove the first element of the date task queue
-            date_task_queue.pop();
-
-            //unlock so that other threads can now work on it
-            pthread_mutex_unlock(&mutex_date_queue);
-
-            //execution for date_task
-            execute_date_task(&date_task);
-        }
-        /*
-         * THIS IF STATEMENT IS TO ASSIGN 1st STAGE TASKS TO THREADS
-         * Since I'm using the array like a queue for 1st stage month task, I have to use month_task_count to check if there's a task
-         * if month_task_count is > 0, then there's a task
-        */
-        else if (month_task_count > 0){
-
-            //Use the lock to prevent other threads to work on it at the same time because after assigning a task, we have to rearrange the queue
-            pthread_mutex_lock(&mutex_month_task_queue);
-
-            /*
-             * VERY IMPORTANT!!!! 
-             * Since multiple threads can work on the same task queue --> double check that month_task_count is still > 0 after getting the lock because
-             * there's a chance that this queue has been emptied by previous thread that was working on this
-             * this is happening because we have mutex lock inside the if statement of (month_task_count > 0), not outside. I intentionally did this
-             * to give priorities to each stage
-            */
-            if (month_task_count <= 0){
-                //so if queue is empty, unlock the lock and continue to stay within the while loop (put thread in wait state)
-                pthread_mutex_unlock(&mutex_month_task_queue);
-                continue;
-            }
-
-            //read the first task inside the month task queue
-            MonthTask task = month_task_queue[0];
-
-            //since using array is faster than queue when it comes to small size, use array like queue
-            //rearrange the task queue because we just read the first task from the array
-            for (int i = 0; i < month_task_count - 1; i++){
-                month_task_queue[i] = month_task_queue[i + 1];
-            }
-            month_task_count--;
-            
-            //unlock so that other threads can now work on it
-            pthread_mutex_unlock(&mutex_month_task_queue);
-
-            //execute operation required for task queue
-            execute_task(&task);
-
-        }
-        //else statement only gets called when all the task queues are empty
-        else{
-            //if no works are available, then break the while loop and let threads to terminate one by one
-            break;
-        }
-    }
+//what a thread of the pool runs for every task, whatever stage it is
+void run_task(TaskPool& pool, PoolTask& task, int worker){
+    if (task.stage == STAGE_OUTPUT)
+        execute_output_task(&task.output_task);
+    else if (task.stage == STAGE_DATE)
+        execute_date_task(&task.date_task, pool, worker);
+    else
+        execute_task(&task.month_task, pool, worker);
 }
 
-int main(){
+/*
+ * Usage: ./task_parallel_p1 [--seasons <file>] [--robust] [--threads <n>]
+ *      --seasons: read the cooling, heating & skipped months, sigma, anomaly delta and baseline from a file (see season_policy.h)
+ *      --robust: median & MAD baseline instead of mean & stdev (see robust_stats.h)
+ *      --threads: number of threads for the first pass and the tasks, the number of hardware threads by default
+*/
+int main(int argc, char* argv[]){
+    //season policy of this run, the default one unless --seasons is given
+    string seasons_arg;
+    bool robust = false;
+    int thread_count = TaskPool::default_threads();
+    for (int i = 1; i < argc; i++){
+        string arg = argv[i];
+        if (arg == "--seasons" && i + 1 < argc)
+            seasons_arg = argv[++i];
+        else if (arg == "--robust")
+            robust = true;
+        else if (arg == "--threads" && i + 1 < argc)
+            thread_count = atoi(argv[++i]);
+    }
+    if (thread_count < 1){
+        cerr << "--threads needs a number of threads >= 1\n";
+        return 1;
+    }
+    string seasons_error;
+    if (!seasons_arg.empty() && !season_policy.load(seasons_arg, seasons_error)){
+        cerr << seasons_error << "\n";
+        return 1;
+    }
+    if (robust)
+        season_policy.robust = true;
     
     //read input stream
     //IMPORTANT! I have changed the input text file name as "bigw12a_log.txt" from "bigw12a.log.txt" to make sure that I am giving the file as text file to the program
     //in this way, it is also easier to read the name of the file and figure out what type it is
-    ifstream file("bigw12a_log.txt");
+    //records come from the binary cache "bigw12a_log.txt.cache" when it is up to date (see convert_log_cache), otherwise from the
+    //memory-mapped text file (see log_input.h)
+    LogInput file("bigw12a_log.txt");
 
     //create output file that I'll be writing all the over-heating and over-cooling time
-    ofstream output_file("output_task_parallel.txt");
-    //close it to save resource. Only open the output file when writing to it
-    output_file.close();
+    //it stays open on the writer thread until every task is done
+    if (!output_writer.open("output_task_parallel.txt")){
+        cerr << "Failed to create output_task_parallel.txt\n";
+        return 1;
+    }
+
+    /*
+     ************************************************************
+     * 
+     * THREADS ASSIGNED FROM HERE
+     * 
+     * Create thread_count threads (a work-stealing pool, see work_stealing_pool.h), they wait for the month tasks of the first pass
+     * 
+     ************************************************************
+    */
+    //keep a time of when the program starts to calculate the total runtime later
+    auto beg = std::chrono::high_resolution_clock::now();
+
+    //the pool's queue of submitted month tasks is big enough for every month of the 100 years the log's two-digit years can have
+    TaskPool pool(thread_count, [&pool](PoolTask& task, int worker){
+        run_task(pool, task, worker);
+    }, ThresholdTable::YEAR_COUNT * 12);
 
     /*
      ************************************************************************************* 
      * First, read through the file, save text input in vector, and find mean + stdev & mean - stdev
      * Exactly the same as the one in data parallelism!
+     * The file is cut into thread_count pieces that are parsed & filtered by all the threads (see parallel_first_pass.h)
      **************************************************************************************
     */
    
-    //keep a time of when the program starts to calculate the total runtime later
-    auto beg = std::chrono::high_resolution_clock::now();
+    //the months of the first pass, the month tasks point at their hour summaries so they're kept until the threads are done
+    vector<MonthRun> months;
     //when input file is open, read it
     if (file.is_open()){
-        string line;
-        
-        //variables to store typical temperature of month per year
-        unordered_map<string, float> typical_temp_per_month;   //takes {month, total typical temp}
-
-        //read all the lines, find typical_temp
-        float prev_temp = 0;
-        string prev_month = "";
-        string prev_year = "";
-        //temporarily store temperatures of all the days within a specific month
-        vector<float> temp_list;
-        unsigned long month_start_idx = 0, month_end_idx = 0;
-
-        //read each line of the input text file
-        while(getline(file, line)){
-            //skip blank line
-            if (line == "")
-                continue;
-
-            //using stringstream, separate each string by 3 segments by whitespace
-            //using stringstream, I separate the line of string into 3 sections (in array) based on the whitespace
-            //so the line gets separated by 3 sections: date, time, and temperature
-            //Ex. "06/05/04 01:59:38 67.8" -> date, time, temperature
-            stringstream ss(line);
-            string word;
-            int idx = 0;
-            //stores date, time, and temperature
-            string each_line[3];
-            while(getline(ss, word, ' ')){
-                each_line[idx] = word;
-                idx++;
-            }
-
-            //find the year
-            string curr_year = each_line[0].substr(6, 2);
-            //find month
-            string curr_month = each_line[0].substr(0, 2);
-            //current time temperature
-            float curr_temp = stod(each_line[2]);
-
-            //NOTE assume these months are the months that really don't need any heating and cooling (to save time)
-            if (curr_month == "03" || curr_month == "04" || curr_month == "09"){
-                prev_temp = 0;  //set prev temp to 0 to prevent 
-                continue;
-            }
-
-            //check for any anomalies. If exist, skip
-            //I placed prev_temp = curr_temp after this if statement so that prev_temp stays the same when anomaly happens
-            if (prev_temp + 2 < curr_temp || prev_temp - 2 > curr_temp){
-                if (prev_temp != 0)
-                    continue;
-            }
-            prev_temp = curr_temp;
-
-            //after skipping anomalies & blank line, save the text input for later use
-            text_input.push_back(line);
-
-            //if saved date is different, then date has been changed. Therefore, find average (typical temp) of that month
-            if (prev_month != curr_month){
-                //check if prev_month is not "". It's "" only when your in the beginning of input file (when there's no prev month)
-                //so catch edge case here
-                if (prev_month != ""){
-                    //when you find out that you're in different month, calculate standard deviation of prev month
-
-                    //---------find standard deviation-----------
-                    //average
-                    typical_temp_per_month[prev_month] = typical_temp_per_month[prev_month] / temp_list.size();
-                    //stdev
-                    float result_val = 0;
-                    int n = temp_list.size();
-                    for (int i = 0; i < n; i++){
-                        result_val += pow(temp_list[i] - typical_temp_per_month[prev_month], 2);
-                    }
-                    float stdev = sqrt(result_val / n);
-                    //-------------------------------------------
-
-                    //cout << "prev_month: " << prev_month << " typical: " << typical_temp_per_month[prev_month] << " stdev: " << stdev << "\n"; 
-                    stdev_high_per_year[prev_year][prev_month] = typical_temp_per_month[prev_month] + stdev;
-                    stdev_low_per_year[prev_year][prev_month] = typical_temp_per_month[prev_month] - stdev;
-
-                    temp_list.clear();
-                    typical_temp_per_month.clear();
-
-                    //if the prev month and curr month are different, save indices of when prev month starts and ends
-                    month_end_idx = text_input.size() - 2;      //update the end idx for previous month
-                    month_task_queue[month_task_count] = MonthTask(month_start_idx, month_end_idx); //assign MonthTask using start and end indices of each month
-                    month_task_count++; //count up the number of month tasks of the queue
-                    month_start_idx = text_input.size() - 1;    //update the start idx for current month (new month because prev month != curr month)
-                }
-                prev_month = curr_month;
-
-                //if in different month, then we might be in different year as well
-                //if we're in different year or prev_year is not yet initialized
-                if (prev_year != curr_year){
-                    prev_year = curr_year;
-                }
-            }
-
-            typical_temp_per_month[curr_month] += curr_temp;    //save to later find the mean
-            temp_list.push_back(curr_temp);   //save temp_list because we want to know the number of elements within that month using this
-        }
-
-        //------if reached the end of file, save the progress of the current month(last month)-------
-        //average
-        typical_temp_per_month[prev_month] = typical_temp_per_month[prev_month] / temp_list.size();
-        //stdev
-        float result_val = 0;
-        int n = temp_list.size();
-        for (int i = 0; i < n; i++){
-            result_val += pow(temp_list[i] - typical_temp_per_month[prev_month], 2);
+        //a month is submitted to the pool as soon as the first pass has its moments (called from the first pass threads)
+        auto queue_month = [&pool](const MonthRun& month){
+            //mean & stdev (or median & MAD) of the whole month (taken from the record store by the first pass)
+            set_thresholds(month_thresholds, month, season_policy);
+
+            //assign MonthTask using start and end indices of each month
+            PoolTask task;
+            task.stage = STAGE_MONTH;
+            task.month_task = MonthTask(month.start_idx, month.end_idx);
+            task.month_task.hours = &month.hours;
+            task.month_task.policy = &season_policy;
+            pool.submit(task);
+        };
+        months = parallel_first_pass(file, thread_count, text_input, season_policy, NULL, queue_month);
+        //no months at all if the log couldn't be read to the end (see parallel_first_pass.h)
+        if (file.read_failed()){
+            cerr << "Failed to read bigw12a_log.txt: " << file.read_error() << "\n";
+            return 1;
         }
-        float stdev = sqrt(result_val / n);
-        //---------------------------------------------------------------------------------
-
-        //calculate mean + stdev, mean - stdev of current month (last month)
-        stdev_high_per_year[prev_year][prev_month] = typical_temp_per_month[prev_month] + stdev;
-        stdev_low_per_year[prev_year][prev_month] = typical_temp_per_month[prev_month] - stdev;
-
-        //also take account of the last month into data_parallel_idx vector, saving its start and end date
-        month_end_idx = text_input.size() - 1;
-        month_task_queue[month_task_count] = MonthTask(month_start_idx, month_end_idx);
-        month_task_count++;
 
         file.close();
     }
 
-    /*
-     ************************************************************
-     * 
-     * THREADS ASSIGNED FROM HERE
-     * 
-     * Create threads and assign tasks to them
-     * 
-     ************************************************************
-    */
-    //threads
-    pthread_t ids[THREAD_NUM];
-    //initialize all the mutex locks because we're gonna use them now
-    pthread_mutex_init(&mutex_month_task_queue, NULL);
-    pthread_mutex_init(&mutex_date_queue, NULL);
-    pthread_mutex_init(&mutex_output_queue, NULL);
-    pthread_mutex_init(&mutex_file, NULL);
-
-    //create threads from here
-    for (int i = 0; i < THREAD_NUM; i++){
-        //read text input that is saved in vector again and check for heating and cooling using multiple threads
-        if (pthread_create(&ids[i], NULL, &start_thread, NULL) != 0 ){
-            perror("Failed to create threads");
-        }
-    }
+    //no more months are coming, the threads terminate once every task of every stage is done. Wait for them
+    pool.close();
+    pool.wait();
 
-    //join threads to terminate from here
-    for (int i = 0; i < THREAD_NUM; i++){
-        //wait for threads to terminate
-        if (pthread_join(ids[i], NULL) != 0){
-            perror("Failed to join the thread");
-        }
+    //the rest of the output, then the file is closed
+    if (!output_writer.close()){
+        cerr << "Failed to write output_task_parallel.txt\n";
     }
 
-    //destroy all the mutex locks at the end because we no longer need them
-    pthread_mutex_destroy(&mutex_month_task_queue);
-    pthread_mutex_destroy(&mutex_date_queue);
-    pthread_mutex_destroy(&mutex_output_queue);
-    pthread_mutex_destroy(&mutex_file);
-
     //measure the time
     auto end = std::chrono::high_resolution_clock::now();
     auto elapsed_time = std::chrono::duration_cast<std::chrono::milliseconds>(end - beg).count();
@@ -0,0 +1,247 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <thread>
+#include "mpmc_ring.h"
+
+/*
+ * ******************************************************
+ *
+ * Work-stealing thread pool for the parallel P1 programs
+ *
+ * The programs used to start a fixed THREAD_NUM 5 threads that all took their tasks from one shared queue. On a big machine most cores
+ * sat idle, and with more threads the one queue (and its lock) is what they all wait on. Here every worker has a deque of its own:
+ *      - a task that makes more tasks (ex. a month of task_parallel_p1 making a task per hour) spawns them into its worker's own deque,
+ *        and the worker takes its next task from the back of it (newest first, its data is still in the cache)
+ *      - a worker whose deque is empty first looks at the tasks submitted from outside the pool (ex. the months handed over by the
+ *        first pass), a lock-free ring (see mpmc_ring.h), and then steals from the front of the other workers' deques (oldest first,
+ *        usually the biggest piece of work left), starting at the next worker and going around
+ * Each deque has its own small lock, and the owner is the only one that takes it most of the time, so there's no one hot lock anymore.
+ *
+ * The pool is done once it's closed (nothing more comes from outside) and every task has run. outstanding counts the tasks that were
+ * submitted or spawned but haven't finished: a task's spawns are counted before the task itself is, so it can't drop to 0 while
+ * anything is still left to do, and no worker quits early (ex. while another one is still making hour tasks out of a month).
+ *
+ * A worker that finds nothing to do goes to sleep on a condition variable instead of spinning, so an idle pool takes no CPU
+ * (ex. data_parallel_p1 while the first pass is still reading the next month). Going to sleep right when a task comes in mustn't lose it,
+ * so every submit/spawn bumps work_epoch, and a worker only sleeps if the epoch is still the one it saw before it last looked everywhere:
+ *      - worker:   epoch = work_epoch, look everywhere, then under park_mutex: sleeping++, wait while work_epoch == epoch
+ *      - producer: push the task, work_epoch++, and only if sleeping != 0 take park_mutex and wake one worker up
+ * Either the producer sees the sleeping worker and wakes it, or the worker sees the new epoch and doesn't sleep. When there's nobody
+ * sleeping (the pool is busy) a task costs one more atomic add and no lock. The last task (or close()) wakes everyone up to finish.
+ *
+ * The number of workers is the number of hardware threads (default_threads()), or set by the program (--threads).
+ *
+ * ******************************************************
+*/
+template <typename T>
+class WorkStealingPool{
+public:
+    //run(task, worker) runs a task on worker (0 ... thread_count - 1), it can spawn() more tasks on that worker
+    typedef std::function<void(T&, int)> Runner;
+
+    //the workers start right away and wait for tasks, at most submit_capacity tasks can wait in the ring of submitted tasks
+    WorkStealingPool(int thread_count, const Runner& run, size_t submit_capacity)
+        : runner(run), submitted(submit_capacity), queues(thread_count < 1 ? 1 : thread_count){
+        pthread_mutex_init(&park_mutex, NULL);
+        pthread_cond_init(&park_cond, NULL);
+        for (size_t i = 0; i < queues.size(); i++){
+            pthread_mutex_init(&queues[i].mutex, NULL);
+        }
+        args.resize(queues.size());
+        ids.resize(queues.size());
+        for (size_t i = 0; i < queues.size(); i++){
+            args[i].pool = this;
+            args[i].worker = i;
+            if (pthread_create(&ids[i], NULL, &start_worker, &args[i]) != 0){
+                perror("Failed to create threads");
+                ids[i] = 0;
+            }
+        }
+    };
+    ~WorkStealingPool(){
+        close();
+        wait();
+        for (size_t i = 0; i < queues.size(); i++){
+            pthread_mutex_destroy(&queues[i].mutex);
+        }
+        pthread_mutex_destroy(&park_mutex);
+        pthread_cond_destroy(&park_cond);
+    };
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    //number of hardware threads, or fallback if that's not known
+    static int default_threads(int fallback = 5){
+        unsigned int count = std::thread::hardware_concurrency();
+        return count == 0 ? fallback : (int)count;
+    };
+
+    int thread_count() const{
+        return queues.size();
+    };
+
+    //a task from outside the pool (any thread)
+    void submit(const T& task){
+        outstanding.fetch_add(1, std::memory_order_relaxed);
+        submitted.push(task);
+        wake_one();
+    };
+
+    //a task from a task that's running on worker, into that worker's own deque
+    void spawn(int worker, const T& task){
+        outstanding.fetch_add(1, std::memory_order_relaxed);
+        WorkerQueue& queue = queues[worker];
+        pthread_mutex_lock(&queue.mutex);
+        queue.tasks.push_back(task);
+        pthread_mutex_unlock(&queue.mutex);
+        wake_one();
+    };
+
+    //nothing more is submitted from outside, the workers finish once everything has run
+    void close(){
+        closed.store(true, std::memory_order_release);
+        wake_all();
+    };
+
+    //wait for the workers to finish (after close())
+    void wait(){
+        for (size_t i = 0; i < ids.size(); i++){
+            if (ids[i] != 0 && pthread_join(ids[i], NULL) != 0){
+                perror("Failed to join the thread");
+            }
+            ids[i] = 0;
+        }
+        //a worker that couldn't be created: whatever is left runs here
+        T task;
+        while (next_task(0, task)){
+            run_task(task, 0);
+        }
+    };
+
+private:
+    struct alignas(64) WorkerQueue{
+        pthread_mutex_t mutex;
+        std::deque<T> tasks;
+    };
+    struct WorkerArg{
+        WorkStealingPool* pool;
+        int worker;
+    };
+
+    static void* start_worker(void* arg){
+        WorkerArg* worker_arg = (WorkerArg*)arg;
+        worker_arg->pool->run_worker(worker_arg->worker);
+        return NULL;
+    };
+
+    //own deque (newest first), then the submitted tasks, then the other workers' deques (oldest first)
+    bool next_task(int worker, T& task){
+        WorkerQueue& own = queues[worker];
+        pthread_mutex_lock(&own.mutex);
+        bool found = !own.tasks.empty();
+        if (found){
+            task = own.tasks.back();
+            own.tasks.pop_back();
+        }
+        pthread_mutex_unlock(&own.mutex);
+        if (found || submitted.pop(task))
+            return true;
+
+        for (size_t k = 1; k < queues.size(); k++){
+            WorkerQueue& victim = queues[(worker + k) % queues.size()];
+            pthread_mutex_lock(&victim.mutex);
+            found = !victim.tasks.empty();
+            if (found){
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+            }
+            pthread_mutex_unlock(&victim.mutex);
+            if (found)
+                return true;
+        }
+        return false;
+    };
+
+    void run_task(T& task, int worker){
+        runner(task, worker);
+        //after everything it spawned was counted. The very last task wakes everyone up so they can finish
+        if (outstanding.fetch_sub(1, std::memory_order_acq_rel) == 1 && closed.load(std::memory_order_acquire))
+            wake_all();
+    };
+
+    bool finished() const{
+        return closed.load(std::memory_order_acquire) && outstanding.load(std::memory_order_acquire) == 0;
+    };
+
+    void wake_one(){
+        work_epoch.fetch_add(1, std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_seq_cst) != 0){
+            pthread_mutex_lock(&park_mutex);
+            pthread_cond_signal(&park_cond);
+            pthread_mutex_unlock(&park_mutex);
+        }
+    };
+
+    void wake_all(){
+        pthread_mutex_lock(&park_mutex);
+        pthread_cond_broadcast(&park_cond);
+        pthread_mutex_unlock(&park_mutex);
+    };
+
+    void run_worker(int worker){
+        T task;
+        //looks that found nothing in a row, a worker yields a few times before it goes to sleep (a task often comes right after)
+        int idle_rounds = 0;
+        while (true){
+            unsigned long epoch = work_epoch.load(std::memory_order_seq_cst);
+            if (next_task(worker, task)){
+                run_task(task, worker);
+                idle_rounds = 0;
+                continue;
+            }
+            //nothing anywhere: done if nothing can come anymore
+            if (finished())
+                break;
+            if (++idle_rounds < SPIN_ROUNDS){
+                sched_yield();
+                continue;
+            }
+            //otherwise sleep until a task comes in (or the pool is done)
+            pthread_mutex_lock(&park_mutex);
+            sleeping.fetch_add(1, std::memory_order_seq_cst);
+            while (work_epoch.load(std::memory_order_seq_cst) == epoch && !finished()){
+                pthread_cond_wait(&park_cond, &park_mutex);
+            }
+            sleeping.fetch_sub(1, std::memory_order_relaxed);
+            pthread_mutex_unlock(&park_mutex);
+            idle_rounds = 0;
+        }
+    };
+
+    static const int SPIN_ROUNDS = 16;
+
+    Runner runner;
+    MpmcRing<T> submitted;
+    std::vector<WorkerQueue> queues;
+    std::vector<WorkerArg> args;
+    std::vector<pthread_t> ids;
+    std::atomic<long> outstanding{0};
+    std::atomic<bool> closed{false};
+
+    //sleeping workers (see the top)
+    pthread_mutex_t park_mutex;
+    pthread_cond_t park_cond;
+    std::atomic<unsigned long> work_epoch{0};
+    std::atomic<int> sleeping{0};
+};
+
+#endif